@@ -0,0 +1,829 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+// latency percentiles and throughput of the log path across front ends, devices, thread counts and
+// formatting options. results are written as JSON to stdout (or --json=FILE) so runs of different commits
+// can be compared, a readable summary goes to stderr
+//
+//	slog_bench [--filter=TEXT] [--threads=N] [--iterations=N] [--json=FILE] [--list]
+//
+// every scenario whose name contains TEXT runs at 1, 2, 4, ... up to N threads (default: the number of
+// cores) with N iterations per thread. throughput comes from a run without any per line timing, the
+// latency percentiles from a second run that times every call, so they include the cost of reading the
+// clock twice
+
+#include <slog/slog.h>
+#include <slog/slog_logdevice_file.h>
+#include <slog/slog_logdevice_console.h>
+#include <slog/slog_logdevice_custom_function.h>
+#include <slog/slog_logdevice_binary_file.h>
+#include <slog/slog_logdevice_blockfile.h>
+#include <slog/slog_logdevice_mmap.h>
+#include <slog/slog_binary.h>
+#include <slog/slog_limit.h>
+#include <slog/slog_logdevice_flightrecorder.h>
+#include <slog/slog_logdevice_socket.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct options
+{
+	options() : threads(std::max(1u, std::thread::hardware_concurrency())), iterations(100000), list(false) { }
+
+	std::string filter;
+	uint32_t threads;
+	uint32_t iterations;
+	std::string json;
+	bool list;
+};
+
+struct result
+{
+	std::string scenario;
+	uint32_t threads;
+	uint64_t lines;
+	double linespersecond;
+	double p50;
+	double p99;
+	double p999;
+	double max;
+};
+
+// drops every line, what is left is the cost of the front end and formatting
+class nulldevice : public slog::logdevice
+{
+	public:
+		explicit nulldevice(const std::string& name) : slog::logdevice(name, false) { attach(); }
+		~nulldevice() { detach(); }
+
+		void writelogline(const slog::logtype& type, const char* line, size_t length) override { }
+};
+
+// called before and after each measured run, inside the timed region for throughput
+struct hooks
+{
+	std::function<void()> before;
+	std::function<void()> after;
+};
+
+class runner
+{
+	public:
+		explicit runner(const options& opts) : _options(opts) { }
+
+		// runs line(i) iterations times on each thread, for every thread count
+		void measure(const std::function<void(uint32_t)>& line, const hooks& around = hooks())
+		{
+			for (uint32_t threads = 1; ; threads *= 2)
+			{
+				if (threads > _options.threads)
+					threads = _options.threads;
+
+				result r;
+				r.scenario = _scenario;
+				r.threads = threads;
+				r.lines = (uint64_t)threads * _options.iterations;
+				r.linespersecond = r.lines / throughput(line, around, threads);
+				latency(line, around, threads, r);
+
+				fprintf(stderr, "%-28s %3u threads %12.0f lines/s  p50 %8.0f ns  p99 %8.0f ns  p999 %8.0f ns\n",
+					r.scenario.c_str(), r.threads, r.linespersecond, r.p50, r.p99, r.p999);
+				results.push_back(r);
+
+				if (threads == _options.threads)
+					break;
+			}
+
+			// what the call site limiters dropped is reported while the scenario's devices are still attached,
+			// logconfig would otherwise report it to the console on its way out, into the JSON on stdout
+			slog::loglimit::flushreports(true);
+		}
+
+		void scenario(const std::string& name) { _scenario = name; }
+
+		std::vector<result> results;
+
+	private:
+		template<typename BODY>
+		void runthreads(uint32_t threads, const BODY& body)
+		{
+			std::atomic<uint32_t> ready(0);
+			std::atomic<bool> go(false);
+
+			std::vector<std::thread> workers;
+			for (uint32_t t = 0; t < threads; t++)
+			{
+				workers.push_back(std::thread([&, t]()
+				{
+					ready++;
+					while (go.load() == false)
+						std::this_thread::yield();
+
+					body(t);
+				}));
+			}
+
+			while (ready.load() != threads)
+				std::this_thread::yield();
+
+			go = true;
+
+			for (auto& worker : workers)
+				worker.join();
+		}
+
+		double throughput(const std::function<void(uint32_t)>& line, const hooks& around, uint32_t threads)
+		{
+			const uint32_t iterations = _options.iterations;
+
+			if (around.before)
+				around.before();
+
+			const auto start = std::chrono::steady_clock::now();
+
+			runthreads(threads, [&](uint32_t)
+			{
+				for (uint32_t i = 0; i < iterations; i++)
+					line(i);
+			});
+
+			if (around.after)
+				around.after();
+
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		void latency(const std::function<void(uint32_t)>& line, const hooks& around, uint32_t threads, result& r)
+		{
+			const uint32_t iterations = _options.iterations;
+			std::vector<std::vector<uint32_t>> samples(threads, std::vector<uint32_t>(iterations));
+
+			if (around.before)
+				around.before();
+
+			runthreads(threads, [&](uint32_t t)
+			{
+				uint32_t* out = samples[t].data();
+				for (uint32_t i = 0; i < iterations; i++)
+				{
+					const auto start = std::chrono::steady_clock::now();
+					line(i);
+					const auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+					out[i] = (uint32_t)std::min<int64_t>(took, 0xffffffff);
+				}
+			});
+
+			if (around.after)
+				around.after();
+
+			std::vector<uint32_t> all;
+			all.reserve((size_t)threads * iterations);
+			for (auto& each : samples)
+				all.insert(all.end(), each.begin(), each.end());
+			std::sort(all.begin(), all.end());
+
+			auto percentile = [&all](double p) { return (double)all[std::min(all.size() - 1, (size_t)(all.size() * p))]; };
+			r.p50 = percentile(0.5);
+			r.p99 = percentile(0.99);
+			r.p999 = percentile(0.999);
+			r.max = all.back();
+		}
+
+		const options& _options;
+		std::string _scenario;
+};
+
+#ifndef _WIN32
+// points stdout at another fd for as long as it is alive
+class redirectstdout
+{
+	public:
+		explicit redirectstdout(int fd)
+		{
+			fflush(stdout);
+			std::cout.flush();
+			_saved = dup(1);
+			dup2(fd, 1);
+		}
+
+		~redirectstdout()
+		{
+			fflush(stdout);
+			std::cout.flush();
+			dup2(_saved, 1);
+			close(_saved);
+		}
+
+	private:
+		int _saved;
+};
+
+// a pipe with a thread reading and discarding whatever comes out of it
+class pipesink
+{
+	public:
+		pipesink()
+		{
+			if (pipe(_fds) != 0)
+				throw std::runtime_error("pipe failed");
+
+			_drain = std::thread([this]()
+			{
+				char buffer[64 * 1024];
+				while (read(_fds[0], buffer, sizeof(buffer)) > 0)
+					;
+			});
+		}
+
+		~pipesink()
+		{
+			close(_fds[1]);
+			_drain.join();
+			close(_fds[0]);
+		}
+
+		int fd() const { return _fds[1]; }
+
+		// a path other code can open to write into the pipe
+		std::string path() const { return "/dev/fd/" + std::to_string(_fds[1]); }
+
+	private:
+		int _fds[2];
+		std::thread _drain;
+};
+
+class devnull
+{
+	public:
+		devnull() : _fd(open("/dev/null", O_WRONLY)) { }
+		~devnull() { close(_fd); }
+
+		int fd() const { return _fd; }
+
+	private:
+		int _fd;
+};
+
+// a unix socket collector with a thread reading and discarding whatever arrives on it
+class socketsink
+{
+	public:
+		socketsink(const char* path, bool stream) : _path(path), _peer(-1)
+		{
+			unlink(path);
+
+			sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			strcpy(address.sun_path, path);
+
+			_fd = socket(AF_UNIX, stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+			if (_fd < 0 || bind(_fd, (const sockaddr*)&address, sizeof(address)) != 0 || (stream && listen(_fd, 1) != 0))
+				throw std::runtime_error("socket failed");
+
+			_drain = std::thread([this, stream]()
+			{
+				const int from = stream ? (_peer = accept(_fd, nullptr, nullptr)) : _fd;
+				char buffer[64 * 1024];
+				while (from >= 0 && recv(from, buffer, sizeof(buffer), 0) > 0)
+					;
+			});
+		}
+
+		~socketsink()
+		{
+			shutdown(_fd, SHUT_RDWR);
+			if (_peer >= 0)
+				shutdown(_peer, SHUT_RDWR);
+			_drain.join();
+			close(_fd);
+			if (_peer >= 0)
+				close(_peer);
+			unlink(_path.c_str());
+		}
+
+	private:
+		std::string _path;
+		int _fd;
+		std::atomic<int> _peer;
+		std::thread _drain;
+};
+#endif
+
+static void line(uint32_t i)
+{
+	slog::info() << "complex " << "string" << " " << i << " " << 30.001f;
+}
+
+static const char benchfile[] = "slog_bench.test.log";
+
+struct scenario
+{
+	const char* name;
+	std::function<void(runner&)> run;
+};
+
+static std::vector<scenario> scenarios()
+{
+	std::vector<scenario> all;
+
+	auto add = [&all](const char* name, std::function<void(runner&)> run)
+	{
+		scenario s = { name, run };
+		all.push_back(s);
+	};
+
+#ifndef _WIN32
+	add("baseline/printf-devnull", [](runner& r)
+	{
+		devnull sink;
+		redirectstdout redirect(sink.fd());
+		r.measure([](uint32_t i) { printf("complex %s %u %f\n", "string", i, 30.001f); }, hooks());
+	});
+
+	add("baseline/iostream-devnull", [](runner& r)
+	{
+		devnull sink;
+		redirectstdout redirect(sink.fd());
+		r.measure([](uint32_t i) { std::cout << "complex " << "string" << " " << i << " " << 30.001f << std::endl; });
+	});
+#endif
+
+	// levels and timestamps, all into a device that drops the lines
+	add("level/enabled", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		r.measure(line);
+	});
+
+	add("level/enabled-untimed", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		const uint32_t every = slog::logstats::timing();
+		slog::logstats::settiming(0);
+		r.measure(line);
+		slog::logstats::settiming(every);
+	});
+
+	add("level/disabled", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { slog::debug() << "complex " << "string" << " " << i << " " << 30.001f; });
+	});
+
+	add("level/disabled-lazy", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { SLOG(slog::debug) << "complex " << "string" << " " << i << " " << 30.001f; });
+	});
+
+	add("timestamps/seconds", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure(line);
+	});
+
+	add("timestamps/microseconds", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamp_precision = slog::timestampprecision::microseconds;
+		nulldevice console("console");
+		r.measure(line);
+	});
+
+	// just the prefix: the per line std::time, localtime_r and iostream padding formatmsg used to do, against
+	// the cached prefix it builds now
+#ifndef _WIN32
+	add("timestamps/prefix-legacy", [](runner& r)
+	{
+		r.measure([](uint32_t i)
+		{
+			tm tmstr;
+			time_t timeval;
+			std::time(&timeval);
+			localtime_r(&timeval, &tmstr);
+
+			std::ostringstream timestamp;
+			timestamp << std::setw(4) << std::setfill('0') << (1900+tmstr.tm_year) << "-";
+			timestamp << std::setw(2) << std::setfill('0') << (tmstr.tm_mon+1) << "-";
+			timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_mday << " ";
+			timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_hour << ":";
+			timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_min << ":";
+			timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_sec;
+
+			std::ostringstream line;
+			line << "[" << timestamp.str() << "] - " << "x";
+		});
+	});
+#endif
+
+	add("timestamps/prefix-cached", [](runner& r)
+	{
+		slog::logconfig config;
+		config.print_logtype = false;
+		r.measure([](uint32_t i)
+		{
+			static thread_local slog::linebuffer out;
+			slog::logconfig::formatmsg(slog::info::type, "x", 1, out);
+		});
+	});
+
+	add("timestamps/cyclecounter", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamp_precision = slog::timestampprecision::microseconds;
+		config.timestamp_source = slog::timestampsource::cyclecounter;
+		nulldevice console("console");
+		r.measure(line);
+	});
+
+	// front ends
+	add("frontend/fmt", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { SLOG_FMT(slog::info, "complex {} {} {}", "string", i, 30.001f); });
+	});
+
+	// one type per line so each shows what operator<< costs for it, custom goes through its own operator<<
+	add("format/int", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { slog::info() << i << " " << -(int64_t)i * 1000003 << " " << (uint64_t)i << 1234567890123ull; });
+	});
+
+	add("format/double", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { slog::info() << 30.001f << " " << i / 7.0 << " " << i * 1e10 << " " << 1.0 / (i + 1); });
+	});
+
+	add("format/string", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		const std::string path("/var/lib/service/data/index.html");
+		r.measure([&path](uint32_t i) { slog::info() << "request " << path << " from " << "upstream-proxy" << " done"; });
+	});
+
+	add("format/custom", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { slog::info() << "at " << std::hex << i << " " << std::setprecision(3) << i / 7.0; });
+	});
+
+	add("format/strobj", [](runner& r)
+	{
+		r.measure([](uint32_t i) { const std::string s = strobj() << "complex " << "string" << " " << i << " " << 30.001f; });
+	});
+
+	const slog::loglayout layouts[] = { slog::loglayout::text, slog::loglayout::json, slog::loglayout::logfmt };
+	const char* kvnames[] = { "frontend/kv-text", "frontend/kv-json", "frontend/kv-logfmt" };
+	for (int l = 0; l < 3; l++)
+	{
+		const slog::loglayout layout = layouts[l];
+		add(kvnames[l], [layout](runner& r)
+		{
+			slog::logconfig config;
+			nulldevice console("console");
+			console.setlayout(layout);
+			r.measure([](uint32_t i) { slog::info().kv("user", i).kv("ms", 30.001f).kv("path", "/index.html") << "request done"; });
+		});
+	}
+
+	add("frontend/binary-file", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_binary_file file(benchfile);
+		r.measure([](uint32_t i) { slog::bin::info() << "complex " << "string" << " " << i << " " << 30.001f; });
+	});
+
+	// the flight recorder copies every line into its ring, set against level/enabled it shows what recording
+	// costs next to formatting and writing the line
+	add("flightrecorder/disabled-level", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_flightrecorder recorder([](const slog::logtype& type, const std::string& line) { });
+		r.measure([](uint32_t i) { slog::debug() << "complex " << "string" << " " << i << " " << 30.001f; });
+	});
+
+	add("flightrecorder/enabled-level", [](runner& r)
+	{
+		slog::logconfig config;
+		config.timestamps = false;
+		nulldevice console("console");
+		slog::logdevice_flightrecorder recorder([](const slog::logtype& type, const std::string& line) { });
+		r.measure(line);
+	});
+
+	// call site limits and the repeat filter, on lines that mostly get dropped
+	add("limit/first", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { SLOG_FIRST(slog::info, 10) << "complex " << "string" << " " << i; });
+	});
+
+	add("limit/sample", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { SLOG_SAMPLE(slog::info, 1000) << "complex " << "string" << " " << i; });
+	});
+
+	add("limit/rate", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { SLOG_RATELIMIT(slog::info, 1000) << "complex " << "string" << " " << i; });
+	});
+
+	add("repeat/identical", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		r.measure([](uint32_t i) { slog::info() << "complex " << "string"; },
+			{ [&config]() { config.startrepeatfilter(); }, [&config]() { config.stoprepeatfilter(); } });
+	});
+
+	// devices
+#ifndef _WIN32
+	add("console/devnull", [](runner& r)
+	{
+		slog::logconfig config;
+		devnull sink;
+		redirectstdout redirect(sink.fd());
+		slog::logdevice_console console;
+		r.measure(line);
+	});
+
+	add("console/pipe", [](runner& r)
+	{
+		slog::logconfig config;
+		pipesink sink;
+		redirectstdout redirect(sink.fd());
+		slog::logdevice_console console;
+		r.measure(line);
+	});
+
+	// just the device on a formatted line: the std::cout sequence and std::endl it used to write per line,
+	// against the single writev it does now
+	add("console/pipe-legacy", [](runner& r)
+	{
+		pipesink sink;
+		redirectstdout redirect(sink.fd());
+		const std::string formatted = "complex string 10 30.001";
+		r.measure([&formatted](uint32_t i)
+		{
+			std::cout.write(formatted.data(), formatted.size());
+			std::cout << std::endl;
+		});
+	});
+
+	add("console/pipe-writev", [](runner& r)
+	{
+		slog::logconfig config;
+		pipesink sink;
+		redirectstdout redirect(sink.fd());
+		slog::logdevice_console console;
+		const std::string formatted = "complex string 10 30.001";
+		r.measure([&console, &formatted](uint32_t i) { console.writelogline(slog::info::type, formatted.data(), formatted.size()); });
+	});
+
+	add("file/devnull", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_file file("/dev/null");
+		r.measure(line, { nullptr, [&file]() { file.flush(); } });
+	});
+
+	add("file/pipe", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		pipesink sink;
+		{
+			slog::logdevice_file file(sink.path());
+			r.measure(line, { nullptr, [&file]() { file.flush(); } });
+		}
+	});
+#endif
+
+	add("file/file", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_file file(benchfile);
+		r.measure(line, { nullptr, [&file]() { file.flush(); } });
+	});
+
+	add("file/file-unbuffered", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::fileflushpolicy policy;
+		policy.maxbuffered = 0;
+		slog::logdevice_file file(benchfile, false, policy);
+		r.measure(line);
+	});
+
+	add("file/file-async", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_file file(benchfile);
+		r.measure(line, { [&config]() { config.startasync(); }, [&config, &file]() { config.stopasync(); file.flush(); } });
+	});
+
+#ifndef _WIN32
+	add("socket/datagram", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		socketsink sink("slog_bench.sock", false);
+		slog::logdevice_socket device("slog_bench.sock");
+		r.measure(line);
+	});
+
+	add("socket/stream-async", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		socketsink sink("slog_bench.sock", true);
+		slog::socketpolicy policy;
+		policy.stream = true;
+		slog::logdevice_socket device("slog_bench.sock", policy);
+		r.measure(line, { [&config]() { config.startasync(); }, [&config]() { config.stopasync(); } });
+	});
+
+	add("mmap/file", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_mmap file(benchfile);
+		r.measure(line);
+	});
+#endif
+
+	add("blockfile/file", [](runner& r)
+	{
+		slog::logconfig config;
+		nulldevice console("console");
+		slog::logdevice_blockfile file(benchfile);
+		r.measure(line, { nullptr, [&file]() { file.flush(); } });
+	});
+
+	add("custom_function/null", [](runner& r)
+	{
+		slog::logconfig config;
+		slog::logdevice_custom_function console("console", [](const slog::logtype& type, const std::string& line) { });
+		r.measure(line);
+	});
+
+	return all;
+}
+
+static void write_json(FILE* out, const options& opts, const std::vector<result>& results)
+{
+	fprintf(out, "{\n");
+	fprintf(out, "  \"version\": \"%s\",\n", slog::getversion().c_str());
+	fprintf(out, "  \"iterations\": %u,\n", opts.iterations);
+	fprintf(out, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(out, "  \"results\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const result& r = results[i];
+		fprintf(out, "    { \"scenario\": \"%s\", \"threads\": %u, \"lines\": %llu, \"lines_per_second\": %.0f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f }%s\n",
+			r.scenario.c_str(), r.threads, (unsigned long long)r.lines, r.linespersecond, r.p50, r.p99, r.p999, r.max, i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[])
+{
+	options opts;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strncmp(argv[i], "--filter=", 9) == 0)
+			opts.filter = argv[i] + 9;
+		else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+			opts.threads = std::max(1, std::atoi(argv[i] + 10));
+		else if (std::strncmp(argv[i], "--iterations=", 13) == 0)
+			opts.iterations = std::max(1, std::atoi(argv[i] + 13));
+		else if (std::strncmp(argv[i], "--json=", 7) == 0)
+			opts.json = argv[i] + 7;
+		else if (std::strcmp(argv[i], "--list") == 0)
+			opts.list = true;
+		else
+		{
+			fprintf(stderr, "usage: %s [--filter=TEXT] [--threads=N] [--iterations=N] [--json=FILE] [--list]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	runner r(opts);
+
+	for (auto& each : scenarios())
+	{
+		if (std::strstr(each.name, opts.filter.c_str()) == nullptr)
+			continue;
+
+		if (opts.list)
+		{
+			printf("%s\n", each.name);
+			continue;
+		}
+
+		try
+		{
+			r.scenario(each.name);
+			each.run(r);
+		}
+		catch (std::exception& e)
+		{
+			fprintf(stderr, "%s: %s\n", each.name, e.what());
+		}
+
+		std::remove(benchfile);
+	}
+
+	if (opts.list)
+		return 0;
+
+	FILE* out = opts.json.empty() ? stdout : fopen(opts.json.c_str(), "w");
+	if (out == nullptr)
+	{
+		fprintf(stderr, "failed to open %s for write\n", opts.json.c_str());
+		return 1;
+	}
+
+	write_json(out, opts, r.results);
+
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
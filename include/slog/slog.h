@@ -27,10 +27,19 @@
 #pragma once
 
 #include <cstdint>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <memory>
 #include <stdexcept>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+
+#include "slog_format.h"
+#include "slog_stats.h"
+#include "slog_clock.h"
 
 #ifndef SLOG_NO_COPY
 #define SLOG_NO_COPY 1
@@ -40,6 +49,12 @@
 #define SLOG_EXCEPTION_PRINT 1
 #endif
 
+// log types with a Priority below this are compiled out, their front ends become nooplogobj
+// e.g. 150 keeps warn and error only. see selectlogobj
+#ifndef SLOG_MIN_PRIORITY
+#define SLOG_MIN_PRIORITY 0
+#endif
+
 #ifndef SLOG_STROBJ_NAMESPACE
 #define SLOG_STROBJ_NAMESPACE 0
 #endif
@@ -62,16 +77,16 @@ namespace slog
 class strobj
 {
 	public:
-		strobj() { }
+		strobj() : ss(&buffer) { }
 
 		template<typename T>
 		friend strobj&& operator<< (strobj&& out, const T& value)
 		{
-			out.ss << value;
+			slog::textformat::insert(out.buffer, out.ss, value);
 			return std::move(out);
 		}
 
-		operator std::string() const { return ss.str(); }
+		operator std::string() const { return buffer.size() ? std::string(buffer.data(), buffer.size()) : std::string(); }
 
 	protected:
 #if SLOG_NO_COPY == 1
@@ -79,7 +94,8 @@ class strobj
 		strobj& operator=(const strobj&);
 #endif
 
-		std::ostringstream ss;
+		slog::linebuffer buffer;
+		std::ostream ss;
 };
 
 #if SLOG_STROBJ_NAMESPACE == 1
@@ -96,6 +112,8 @@ namespace slog
 	uint32_t getminorversion();
 	uint32_t getpatchversion();
 
+	class logcategory;
+
 	// a null logobj that all log object get replaced with when they are compiled out
 	// see SLOG_DISABLE_*
 	template<typename TYPE>
@@ -104,6 +122,14 @@ namespace slog
 		public:
 			nooplogobj() { }
 
+			template<typename FUNCTION, typename = decltype(std::declval<FUNCTION&>()(std::declval<std::ostream&>()))>
+			explicit nooplogobj(FUNCTION&& build) { }
+
+			explicit nooplogobj(const logcategory& category) { }
+
+			template<typename FUNCTION, typename = decltype(std::declval<FUNCTION&>()(std::declval<std::ostream&>()))>
+			nooplogobj(const logcategory& category, FUNCTION&& build) { }
+
 			template<typename T>
 			friend nooplogobj&& operator<< (nooplogobj&& out, const T& value)
 			{
@@ -112,6 +138,18 @@ namespace slog
 
 			operator std::string() const { return ""; }
 
+			template<typename T>
+			nooplogobj&& kv(const char* key, const T& value) { return std::move(*this); }
+
+			static bool isenabled() { return false; }
+			static bool isenabled(const logcategory& category) { return false; }
+			static bool iswritten() { return false; }
+			static bool iswritten(const logcategory& category) { return false; }
+			static void filtered() { }
+
+			template<typename... ARGS>
+			static void fmt(const char* format, const ARGS&... args) { }
+
 			static TYPE type;
 
 		protected:
@@ -141,9 +179,9 @@ namespace slog
 
 	struct logtype
 	{
-		logtype() : name("unnamed"), enabled(true), priority(0), tag(0), color(consolecolor::gray) { }
+		logtype() : usestderr(false), name("unnamed"), enabled(true), priority(0), tag(0), color(consolecolor::gray) { }
 
-		logtype(const char* _name, uint32_t _prio, uint32_t _tag, consolecolor _color) : enabled(true), name(_name), priority(_prio), tag(_tag), color(_color) {}
+		logtype(const char* _name, uint32_t _prio, uint32_t _tag, consolecolor _color) : usestderr(false), enabled(true), name(_name), priority(_prio), tag(_tag), color(_color) {}
 
 		bool usestderr;
 		uint32_t tag;
@@ -153,8 +191,46 @@ namespace slog
 		consolecolor color;
 	};
 
+	// a formatted line of a batch, see logdevice::writeloglines
+	struct logline
+	{
+		const logtype* type;
+		const char* line;	// not null terminated
+		size_t length;
+		std::chrono::system_clock::time_point when;	// when it was logged, the async writer hands lines over later
+	};
+
 	class logdevice;
 	class logdevice_console;
+	class asyncwriter;
+	class repeatfilter;
+	class logdevice_flightrecorder;
+
+#if defined(_MSC_VER) && _MSC_VER <= 1600
+	enum timestampprecision
+#else
+	enum class timestampprecision : uint8_t
+#endif
+	{
+		seconds,
+		milliseconds,
+		microseconds,
+	};
+
+	// how a device wants its lines laid out, see logdevice::setlayout. fields added with logobj::kv stay
+	// typed until this point
+#if defined(_MSC_VER) && _MSC_VER <= 1600
+	enum loglayout
+#else
+	enum class loglayout : uint8_t
+#endif
+	{
+		text,		// [timestamp] - [type] - message key=value ...
+		json,		// one JSON object per line (JSON Lines)
+		logfmt,		// time=... level=... msg=... key=value ...
+	};
+
+	static const uint32_t loglayoutcount = 3;
 
 	class logconfig
 	{
@@ -166,18 +242,69 @@ namespace slog
 			void parse(int argc, char* argv[]);
 
 			static std::string formatmsg(const logtype& ltype, const std::string& msg);
+			static void formatmsg(const logtype& ltype, const char* msg, size_t length, linebuffer& out);
+			static void formatmsg(const logtype& ltype, const char* msg, size_t length, linebuffer& out, std::chrono::system_clock::time_point when);
+
+			// fields are what logobj::kv collected (see kvformat), laid out the way layout asks for
+			static void formatmsg(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength,
+				linebuffer& out, std::chrono::system_clock::time_point when, loglayout layout);
+
+			// hands a message to the repeat filter when one is running, or else to dispatchmessage, and to the
+			// flight recorder. recordonly messages only go to the flight recorder
+			static void writemessage(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength, linebuffer& line,
+				bool recordonly = false);
+
+			// formats the message once for every layout the devices use and writes it, line is scratch space
+			static void dispatchmessage(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength, linebuffer& line);
+
+			// hands a formatted line to the devices, or to the background writer when the current config is async
+			static void writeline(const logtype& ltype, const char* line, size_t length);
+			static void writetodevices(const logtype& ltype, const char* line, size_t length, loglayout layout = loglayout::text);
+
+			// hands each device the lines of the batch it takes in one writeloglines call
+			static void writebatchtodevices(const logline* lines, size_t count, loglayout layout = loglayout::text);
+
+			// hands an encoded binary record to the devices, see slog_binary.h
+			static void writerecord(const logtype& ltype, std::chrono::system_clock::time_point when, const char* record, size_t length);
+
+			// lines are queued on a bounded lock-free queue and written out by a dedicated thread,
+			// whatever is still queued gets written when stopasync is called or the config is destroyed.
+			// stopasync waits for the threads that are pushing a line at the time, so it must not be called
+			// from a device
+			void startasync(size_t queuecapacity = 8192);
+			void stopasync();
+			bool isasync() const { return _async.load(std::memory_order_relaxed) != nullptr; }
+
+			// identical consecutive messages of a log type are written once, followed by a "last message
+			// repeated N times" line when the repeats end, after timeout, or when the filter is stopped.
+			// like stopasync, stoprepeatfilter must not be called from a device
+			void startrepeatfilter(std::chrono::milliseconds timeout = std::chrono::seconds(30));
+			void stoprepeatfilter();
 
 			bool usecolor;
 			bool timestamps;
 			bool print_logtype;
 			bool print_priority;
+			timestampprecision timestamp_precision;
+			bool utc_timestamps; // ISO-8601 in UTC, e.g. 2014-06-01T13:45:10.250Z
+			timestampsource timestamp_source;
 
-			static std::map<std::string, logdevice*> print_functions;
+			// the time a line is stamped with, read from the source the current config asks for
+			static std::chrono::system_clock::time_point now();
 
 			static const logconfig* _cur_config;
 
+			// while a flight recorder is alive lines of every level are built, see slog_logdevice_flightrecorder.h
+			static bool recording() { return _recorder.load(std::memory_order_relaxed) != nullptr; }
+			static std::atomic<logdevice_flightrecorder*> _recorder;
+
 		private:
+			// the writer of the current config, the caller holds a deviceregistry::reader for as long as it uses it
+			static asyncwriter* currentasync();
+
 			const logconfig* _prev_config;
+			std::atomic<asyncwriter*> _async;	// loaded under a deviceregistry::reader, see stopasync
+			std::atomic<repeatfilter*> _repeats;	// loaded under a deviceregistry::reader, see stoprepeatfilter
 	};
 
 #if SLOG_EXCEPTION_PRINT == 1
@@ -194,65 +321,309 @@ namespace slog
 	class logdevice
 	{
 		public:
-			logdevice(std::string deviceName);
+			// a device is registered as soon as the base is constructed unless attachnow is false, in which
+			// case the derived constructor calls attach() once it is fully set up
+			logdevice(std::string deviceName, bool attachnow = true);
 			virtual ~logdevice();
 
-			virtual void writelogline(const slog::logtype& type, const std::string& line) = 0;
+			// line is not null terminated and is only valid for the duration of the call
+			virtual void writelogline(const slog::logtype& type, const char* line, size_t length) = 0;
+
+			void writelogline(const slog::logtype& type, const std::string& line) { writelogline(type, line.data(), line.size()); }
+
+			// lines in the order they were logged, only valid for the duration of the call. devices that can
+			// write many lines at once override this, by default each line goes to writelogline
+			virtual void writeloglines(const logline* lines, size_t count);
+
+			// binary records from the slog::bin front ends, only devices that store them override this
+			virtual void writerecord(const slog::logtype& type, std::chrono::system_clock::time_point when, const char* record, size_t length) { }
+
+			const std::string& name() const { return m_deviceName; }
+
+			// writelogline and writeloglines, counted and timed for logstats
+			void writemeasured(const slog::logtype& type, const char* line, size_t length);
+			void writemeasured(const logline* lines, size_t count);
+			const devicecounters& counters() const { return m_counters; }
+
+			// devices get text lines unless they ask for another layout
+			loglayout layout() const { return m_layout; }
+			void setlayout(loglayout layout);
+
+			// lines below this priority are not written to the device, 0 takes everything
+			uint32_t minpriority() const { return m_minpriority; }
+			void setminpriority(uint32_t priority);
+
+		protected:
+			void attach();
+
+			// unregisters the device and waits until no thread is still writing to it. derived devices
+			// should call this first thing in their destructor, the base destructor is too late since
+			// the derived part is already gone by then
+			void detach();
 
 		private:
 			std::string m_deviceName;
-			logdevice* _prev_device;
+			bool m_attached;
+			loglayout m_layout;
+			uint32_t m_minpriority;
+			devicecounters m_counters;
+	};
+
+	//---------------------------------------------------------------------
+
+	// the devices lines are written to. the log path walks an immutable array of devices without taking
+	// any lock; adding or removing a device builds a new array, publishes it with an atomic swap and
+	// waits until every thread that may still be walking the old array is done before freeing it.
+	// a thread that holds a reader, a device or a flight recorder dump callback for instance, cannot wait
+	// for itself: add, remove, refresh and synchronize throw std::logic_error when called from one
+	class deviceregistry
+	{
+		public:
+			// the read side of one thread, see slog.cpp
+			struct readerstate;
+
+			struct snapshot
+			{
+				// the devices that take lines at or above a priority, one band per distinct device minimum
+				struct band
+				{
+					uint32_t minpriority;
+					uint64_t devicemask;	// bit n for devices[n], devices past the 64th are checked one by one
+					uint32_t layoutmask;	// bit n when one of the devices uses layout n
+				};
+
+				std::vector<logdevice*> devices;
+				std::vector<loglayout> layouts;			// of each device when the snapshot was taken
+				std::vector<uint32_t> minpriorities;	// of each device when the snapshot was taken
+				std::vector<band> bands;				// highest minpriority first
+
+				// nullptr when no device takes the priority
+				const band* accepting(uint32_t priority) const
+				{
+					for (auto& each : bands)
+					{
+						if (priority >= each.minpriority)
+							return &each;
+					}
+					return nullptr;
+				}
+
+				bool accepts(const band& b, size_t device, uint32_t priority) const
+				{
+					return device < 64 ? ((b.devicemask >> device) & 1) != 0 : priority >= minpriorities[device];
+				}
+			};
+
+			// pins the current snapshot for as long as it is alive
+			class reader
+			{
+				public:
+					reader();
+					~reader();
+
+					logdevice* const* begin() const { return _snap ? _snap->devices.data() : nullptr; }
+					logdevice* const* end() const { return _snap ? _snap->devices.data() + _snap->devices.size() : nullptr; }
+
+					const snapshot* get() const { return _snap; }
+
+				private:
+					readerstate* _state;
+					const snapshot* _snap;
+
+					reader(const reader&);
+					reader& operator=(const reader&);
+			};
+
+			// a device registered under a name already in use shadows the previous one until it is removed
+			static void add(const std::string& name, logdevice* device);
+			static void remove(const std::string& name, logdevice* device);
+
+			// publishes a fresh snapshot, for when something the snapshot caches about a device changed
+			static void refresh();
+
+			// waits until every reader that was alive when it was called is gone
+			static void synchronize();
+
+			// whether any device takes lines of this priority, a single load without pinning a snapshot
+			static bool accepts(uint32_t priority) { return priority >= _lowestpriority.load(std::memory_order_relaxed); }
+
+			// adds the counters of every device, including the ones already removed, to devices by name
+			static void readstats(std::map<std::string, logstats::devicestats>& devices);
+
+			static std::atomic<uint32_t> _lowestpriority;
+
+		private:
+			static readerstate* threadstate();
 	};
 	
 	//---------------------------------------------------------------------
 
+	// a named subsystem (net.http, db.pool) with its own threshold. the threshold comes from the most specific
+	// rule set for the category or one of its parents (--log=db.*:debug, --log=net:warn, --log=*:info) and is
+	// precomputed into the category whenever rules or categories are added, so checking it is a single load.
+	// a category no rule applies to follows the enabled flag of each log type
+	//
+	//	static slog::logcategory& pool = slog::logcategory::get("db.pool");
+	//	slog::debug(pool) << "connections " << count;
+	//
+	class logcategory
+	{
+		public:
+			static const uint32_t unset = 0xffffffff;
+			static const uint32_t off = 0xfffffffe;
+
+			// categories live until the process exits, the reference can be kept around
+			static logcategory& get(const std::string& name);
+
+			// pattern is a category name, optionally ending in .* which means the same, or * for all
+			// categories. lines with a priority at or above threshold are logged, off disables them all
+			// and unset removes the rule
+			static void setlevel(const std::string& pattern, uint32_t threshold);
+			static void clearlevels();
+
+			// a level name (verbose, debug, info, warn, error, off) or a number
+			static bool parselevel(const std::string& level, uint32_t& threshold);
+
+			bool isenabled(const logtype& type) const
+			{
+				const uint32_t threshold = _threshold.load(std::memory_order_relaxed);
+				return threshold == unset ? type.enabled : type.priority >= threshold;
+			}
+
+			const std::string& name() const { return _name; }
+
+		private:
+			logcategory(const std::string& name);
+
+			std::string _name;
+			std::atomic<uint32_t> _threshold;
+
+			logcategory(const logcategory&);
+			logcategory& operator=(const logcategory&);
+	};
+
+	//---------------------------------------------------------------------
+
 	template<typename TYPE>
 	class logobj
 	{
 		public:
-			logobj() { }
+			logobj() : _scratch(start(isenabled(), iswritten())) { }
+
+			// the line is built by a callable that is only invoked when the level is enabled, so nothing it
+			// does is evaluated otherwise
+			//
+			//	slog::debug([&](std::ostream& s) { s << "state " << dumpstate(); });
+			//
+			template<typename FUNCTION, typename = decltype(std::declval<FUNCTION&>()(std::declval<std::ostream&>()))>
+			explicit logobj(FUNCTION&& build) : _scratch(start(isenabled(), iswritten()))
+			{
+				if (_scratch)
+					build(_scratch->stream);
+			}
+
+			// the line is prefixed with the category name and only logged when the category lets it through
+			explicit logobj(const logcategory& category) : _scratch(start(isenabled(category), iswritten(category)))
+			{
+				if (_scratch)
+					prefix(category);
+			}
+
+			template<typename FUNCTION, typename = decltype(std::declval<FUNCTION&>()(std::declval<std::ostream&>()))>
+			logobj(const logcategory& category, FUNCTION&& build) : _scratch(start(isenabled(category), iswritten(category)))
+			{
+				if (_scratch)
+				{
+					prefix(category);
+					build(_scratch->stream);
+				}
+			}
 
 			~logobj()
 			{
+				if (_scratch == nullptr)
+					return;
+
 				try
 				{
-					if (type.enabled)
-					{
-						std::string line = logconfig::formatmsg(type, ss.str());
-
-#if defined(_MSC_VER) && _MSC_VER <= 1600
-						for (auto& each = logconfig::print_functions.begin(); each != logconfig::print_functions.end(); ++each)
-						{
-							auto pf = each->second;
-#else
-						for (auto& each : logconfig::print_functions)
-						{
-							auto pf = each.second;
-#endif
-							if (pf)
-								pf->writelogline(type, line);
-						}
-					}
+					logconfig::writemessage(type, _scratch->message.data(), _scratch->message.size(), _scratch->fields.data(), _scratch->fields.size(), _scratch->line,
+						_scratch->recordonly);
 				}
 				catch (...)
 				{
+					logstats::countexception();
 					std::cerr << "logobj caught an exception most likely thrown by a writelogline" << std::endl;
 				}
+
+				logscratch::release();
 			}
 
 			template<typename T>
 			friend logobj&& operator<< (logobj&& out, const T& value)
 			{
-				if (type.enabled)
-					out.ss << value;
+				if (out._scratch)
+					textformat::insert(out._scratch->message, out._scratch->stream, value);
 
 				return std::move(out);
 			}
 
+			// adds a typed field that devices lay out according to their layout, as key=value in text
+			//
+			//	slog::info().kv("user", id).kv("ms", elapsed) << "request done";
+			//
+			template<typename T>
+			logobj&& kv(const char* key, const T& value)
+			{
+				if (_scratch)
+					kvformat::encode(*_scratch, key, value);
+
+				return std::move(*this);
+			}
+
+			// whether the line gets built: when it is written to the devices or a flight recorder is recording
+			static bool isenabled() { return iswritten() || logconfig::recording(); }
+			static bool isenabled(const logcategory& category) { return iswritten(category) || logconfig::recording(); }
+
+			// also false when no device takes lines of this priority
+			static bool iswritten() { return type.enabled && deviceregistry::accepts(type.priority); }
+			static bool iswritten(const logcategory& category) { return category.isenabled(type) && deviceregistry::accepts(type.priority); }
+
+			// counts a line that was not written because its level was off
+			static void filtered() { logstats::countfiltered(); }
+
+			// formats one {} per argument, use it through SLOG_FMT to have the format checked at compile time
+			template<typename... ARGS>
+			static void fmt(const char* format, const ARGS&... args)
+			{
+				logobj line;
+				if (line._scratch)
+					textformat::formatargs(line._scratch->message, line._scratch->stream, format, args...);
+			}
+
 			static TYPE type;
 
 		protected:
-			std::ostringstream ss;
+			static logscratch* start(bool built, bool written)
+			{
+				if (written == false)
+					filtered();
+
+				if (built == false)
+					return nullptr;
+
+				logscratch* scratch = &logscratch::acquire();
+				scratch->recordonly = (written == false);
+				return scratch;
+			}
+
+			void prefix(const logcategory& category)
+			{
+				_scratch->message.append('[');
+				_scratch->message.append(category.name());
+				_scratch->message.append("] ", 2);
+			}
+
+			logscratch* _scratch;
 		
 #if SLOG_NO_COPY == 1
 		private:
@@ -271,38 +642,57 @@ namespace slog
 
 	// --------------------------------------------
 
+	// the front end for a log type: LOGOBJ, or nooplogobj when the type's compile time Priority is below
+	// SLOG_MIN_PRIORITY. custom log types get the same treatment by declaring a static const uint32_t Priority
+	//
+	//	typedef slog::selectlogobj<logtype_audit>::type audit;
+	//
+	template<typename TYPE, template<typename> class LOGOBJ = logobj>
+	struct selectlogobj
+	{
+		typedef typename std::conditional<(TYPE::Priority >= SLOG_MIN_PRIORITY), LOGOBJ<TYPE>, nooplogobj<TYPE>>::type type;
+	};
+
+	// --------------------------------------------
+
 	struct logtype_info : logtype
 	{
+		static const uint32_t Priority = 100;
 		static const uint32_t Tag = 0x696e666f;
 		logtype_info();
 	};
 
 	struct logtype_warn : logtype
 	{
+		static const uint32_t Priority = 150;
 		static const uint32_t Tag = 0x7761726e;
 		logtype_warn();
 	};
 
 	struct logtype_error : logtype
 	{
+		static const uint32_t Priority = 200;
 		static const uint32_t Tag = 0x6572726f;
 		logtype_error();
 	};
 
 	struct logtype_verbose : logtype
 	{
+		static const uint32_t Priority = 50;
 		static const uint32_t Tag = 0x76657262;
 		logtype_verbose();
 	};
 
 	struct logtype_debug : logtype
 	{
+		static const uint32_t Priority = 50;
 		static const uint32_t Tag = 0x64656267;
 		logtype_debug();
 	};
 
 	struct logtype_success : logtype
 	{
+		static const uint32_t Priority = 100;
 		static const uint32_t Tag = 0x73756363;
 		logtype_success();
 	};
@@ -310,41 +700,49 @@ namespace slog
 	// --------------------------------------------
 
 #if SLOG_DISABLE_INFO != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_info> info;
+	typedef selectlogobj<logtype_info>::type info;
 #else
 	typedef nooplogobj<logtype_info> info;
 #endif
 
 #if SLOG_DISABLE_WARN != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_warn> warn;
+	typedef selectlogobj<logtype_warn>::type warn;
 #else
 	typedef nooplogobj<logtype_warn> warn;
 #endif
 
 #if SLOG_DISABLE_VERBOSE != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_verbose> verbose;
+	typedef selectlogobj<logtype_verbose>::type verbose;
 #else
 	typedef nooplogobj<logtype_verbose> verbose;
 #endif
 
 #if SLOG_DISABLE_ERROR != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_error> error;
+	typedef selectlogobj<logtype_error>::type error;
 #else
 	typedef nooplogobj<logtype_error> error;
 #endif
 
 #if SLOG_DISABLE_DEBUG != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_debug> debug;
+	typedef selectlogobj<logtype_debug>::type debug;
 #else
 	typedef nooplogobj<logtype_debug> debug;
 #endif
 
 #if SLOG_DISABLE_SUCCESS != 1 && SLOG_DISABLE != 1
-	typedef logobj<logtype_success> success;
+	typedef selectlogobj<logtype_success>::type success;
 #else
 	typedef nooplogobj<logtype_success> success;
 #endif
 
+	// the stream form with lazy arguments, nothing right of the macro is evaluated when the level is
+	// disabled and a compiled out level leaves nothing behind
+	//
+	//	SLOG(slog::debug) << "state " << dumpstate();
+	//
+#define SLOG(LOGOBJ) if (LOGOBJ::isenabled() == false) LOGOBJ::filtered(); else LOGOBJ()
+#define SLOG_CATEGORY(LOGOBJ, CATEGORY) if (LOGOBJ::isenabled(CATEGORY) == false) LOGOBJ::filtered(); else LOGOBJ(CATEGORY)
+
 #ifndef BUILDING_SLOG
 	extern template class logobj<logtype_info>;
 	extern template class logobj<logtype_warn>;
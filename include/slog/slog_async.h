@@ -0,0 +1,165 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace slog
+{
+	// bounded multi-producer queue, based on Dmitry Vyukov's array queue. every cell carries a sequence
+	// number so producers only ever contend on the enqueue position and never take a lock. there is a
+	// single consumer so the dequeue position needs no atomics. values are filled in and taken out of the
+	// cells in place, a popped cell keeps what the consumer's value held so buffers are reused, not freed
+	template<typename T>
+	class mpscqueue
+	{
+		public:
+			explicit mpscqueue(size_t capacity) : _mask(roundup(capacity) - 1), _cells(new cell[_mask + 1]), _enqueuepos(0), _dequeuepos(0)
+			{
+				for (size_t i = 0; i <= _mask; i++)
+					_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+
+			// fill(T&) writes the value into its cell
+			template<typename FILL>
+			bool trypush(const FILL& fill)
+			{
+				size_t pos = _enqueuepos.load(std::memory_order_relaxed);
+				for (;;)
+				{
+					cell& c = _cells[pos & _mask];
+					const size_t seq = c.sequence.load(std::memory_order_acquire);
+					const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+					if (diff == 0)
+					{
+						if (_enqueuepos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						{
+							fill(c.value);
+							c.sequence.store(pos + 1, std::memory_order_release);
+							return true;
+						}
+					}
+					else if (diff < 0)
+						return false; // full
+					else
+						pos = _enqueuepos.load(std::memory_order_relaxed);
+				}
+			}
+
+			bool trypop(T& value)
+			{
+				cell& c = _cells[_dequeuepos & _mask];
+				if ((intptr_t)c.sequence.load(std::memory_order_acquire) - (intptr_t)(_dequeuepos + 1) < 0)
+					return false; // empty
+
+				std::swap(value, c.value);
+				c.sequence.store(_dequeuepos + _mask + 1, std::memory_order_release);
+				_dequeuepos++;
+				return true;
+			}
+
+			// only meaningful on the consumer thread
+			bool empty() const
+			{
+				const cell& c = _cells[_dequeuepos & _mask];
+				return (intptr_t)c.sequence.load(std::memory_order_acquire) - (intptr_t)(_dequeuepos + 1) < 0;
+			}
+
+			size_t capacity() const { return _mask + 1; }
+
+		private:
+			struct cell
+			{
+				std::atomic<size_t> sequence;
+				T value;
+			};
+
+			static size_t roundup(size_t value)
+			{
+				size_t pow2 = 2;
+				while (pow2 < value)
+					pow2 <<= 1;
+				return pow2;
+			}
+
+			const size_t _mask;
+			std::unique_ptr<cell[]> _cells;
+			char _pad0[64];
+			std::atomic<size_t> _enqueuepos;
+			char _pad1[64];
+			size_t _dequeuepos;
+
+			mpscqueue(const mpscqueue&);
+			mpscqueue& operator=(const mpscqueue&);
+	};
+
+	// owns the writer thread of an async logconfig, see logconfig::startasync
+	class asyncwriter
+	{
+		public:
+			explicit asyncwriter(size_t queuecapacity);
+			~asyncwriter(); // drains whatever is still queued before joining the writer thread
+
+			// called by the logging threads; when the queue is full the caller yields until the writer catches up.
+			// the line is copied into the queue's own buffers, which only allocate while they grow to the longest line
+			void push(const logtype& ltype, const char* line, size_t length, std::chrono::system_clock::time_point when, loglayout layout = loglayout::text);
+
+		private:
+			struct record
+			{
+				const logtype* type;
+				std::string line;
+				std::chrono::system_clock::time_point when;
+				loglayout layout;
+			};
+
+			void run();
+			bool drain();
+
+			// the devices get what is queued in batches of up to this many lines
+			static const size_t batchsize = 256;
+
+			mpscqueue<record> _queue;
+			std::vector<record> _batch;
+			std::vector<logline> _lines;
+			std::atomic<bool> _stop;
+			std::atomic<bool> _sleeping;
+			std::mutex _mutex;
+			std::condition_variable _wakeup;
+			std::thread _thread;
+
+			asyncwriter(const asyncwriter&);
+			asyncwriter& operator=(const asyncwriter&);
+	};
+}
@@ -0,0 +1,248 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <type_traits>
+
+namespace slog
+{
+	// binary log layout, all values in the byte order of the machine that wrote them:
+	//
+	//	file header:	"SLOGBIN1" u32 byteorder
+	//	type:			u8 'T' u16 id u32 priority u32 tag u8 color u8 usestderr u16 namelength name
+	//	record:			u8 'R' u16 typeid i64 microseconds since epoch u32 length arguments
+	//	text line:		u8 'L' u16 typeid u32 length line (lines from the text front ends, already formatted)
+	//
+	// every argument of a record is a one byte tag followed by its value: 'i' i64, 'u' u64, 'd' double,
+	// 'c' char, 'b' u8 and 's' u32 length + bytes. types without a binary encoding are formatted at the
+	// call site through operator<< and stored as 's'
+	namespace binformat
+	{
+		static const char magic[8] = { 'S', 'L', 'O', 'G', 'B', 'I', 'N', '1' };
+		static const uint32_t byteorder = 0x01020304;
+
+		enum entrykind : uint8_t
+		{
+			entry_type = 'T',
+			entry_record = 'R',
+			entry_line = 'L',
+		};
+
+		enum argtag : uint8_t
+		{
+			arg_int = 'i',
+			arg_uint = 'u',
+			arg_double = 'd',
+			arg_char = 'c',
+			arg_bool = 'b',
+			arg_string = 's',
+		};
+
+		template<typename T>
+		inline void put(linebuffer& out, T value)
+		{
+			out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+
+		inline void putstring(linebuffer& out, const char* text, size_t length)
+		{
+			out.append((char)arg_string);
+			put<uint32_t>(out, (uint32_t)length);
+			out.append(text, length);
+		}
+
+		inline void encode(logscratch& s, bool value) { s.message.append((char)arg_bool); put<uint8_t>(s.message, value ? 1 : 0); }
+		inline void encode(logscratch& s, char value) { s.message.append((char)arg_char); s.message.append(value); }
+		inline void encode(logscratch& s, signed char value) { s.message.append((char)arg_char); s.message.append((char)value); }
+		inline void encode(logscratch& s, unsigned char value) { s.message.append((char)arg_char); s.message.append((char)value); }
+		inline void encode(logscratch& s, const char* value) { value = textformat::nonnull(value); putstring(s.message, value, std::strlen(value)); }
+		inline void encode(logscratch& s, const std::string& value) { putstring(s.message, value.data(), value.size()); }
+
+		// integers and floating point values are stored raw, anything else is formatted right away
+		template<typename T>
+		inline void encode(logscratch& s, const T& value, std::true_type /*signed*/, std::false_type /*floating*/) { s.message.append((char)arg_int); put<int64_t>(s.message, (int64_t)value); }
+
+		template<typename T>
+		inline void encode(logscratch& s, const T& value, std::false_type /*signed*/, std::false_type /*floating*/) { s.message.append((char)arg_uint); put<uint64_t>(s.message, (uint64_t)value); }
+
+		template<typename T>
+		inline void encode(logscratch& s, const T& value, std::true_type /*signed*/, std::true_type /*floating*/) { s.message.append((char)arg_double); put<double>(s.message, (double)value); }
+
+		template<typename T>
+		inline typename std::enable_if<std::is_arithmetic<T>::value>::type encode(logscratch& s, const T& value)
+		{
+			encode(s, value, std::integral_constant<bool, std::is_signed<T>::value>(), std::integral_constant<bool, std::is_floating_point<T>::value>());
+		}
+
+		template<typename T>
+		inline typename std::enable_if<!std::is_arithmetic<T>::value>::type encode(logscratch& s, const T& value)
+		{
+			s.message.append((char)arg_string);
+			const size_t lengthpos = s.message.size();
+			put<uint32_t>(s.message, 0);
+
+			s.stream << value;
+
+			const uint32_t length = (uint32_t)(s.message.size() - lengthpos - sizeof(uint32_t));
+			s.message.overwrite(lengthpos, reinterpret_cast<const char*>(&length), sizeof(length));
+		}
+	}
+
+	// front end that captures its arguments as a binary record instead of formatting a line. records only
+	// reach devices that store them (logdevice_binary_file), slog_decode turns them back into text
+	template<typename TYPE>
+	class binlogobj
+	{
+		public:
+			binlogobj() : _scratch(start(iswritten())) { }
+
+			~binlogobj()
+			{
+				if (_scratch == nullptr)
+					return;
+
+				try
+				{
+					logconfig::writerecord(type, logconfig::now(), _scratch->message.data(), _scratch->message.size());
+				}
+				catch (...)
+				{
+					logstats::countexception();
+					std::cerr << "binlogobj caught an exception most likely thrown by a writerecord" << std::endl;
+				}
+
+				logscratch::release();
+			}
+
+			template<typename T>
+			friend binlogobj&& operator<< (binlogobj&& out, const T& value)
+			{
+				if (out._scratch)
+					binformat::encode(*out._scratch, value);
+
+				return std::move(out);
+			}
+
+			// same as logobj, also false when no device takes records of this priority
+			static bool iswritten() { return type.enabled && deviceregistry::accepts(type.priority); }
+
+			// same type object as the text front end, so enabling info also enables bin::info
+			static TYPE& type;
+
+		protected:
+			static logscratch* start(bool written)
+			{
+				if (written == false)
+				{
+					logstats::countfiltered();
+					return nullptr;
+				}
+
+				return &logscratch::acquire();
+			}
+
+			logscratch* _scratch;
+
+#if SLOG_NO_COPY == 1
+		private:
+			binlogobj(const binlogobj&);
+			binlogobj& operator=(const binlogobj&);
+#endif
+	};
+
+	template<typename TYPE> TYPE& binlogobj<TYPE>::type = logobj<TYPE>::type;
+
+	namespace bin
+	{
+#if SLOG_DISABLE_INFO != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_info, binlogobj>::type info;
+#else
+		typedef nooplogobj<logtype_info> info;
+#endif
+
+#if SLOG_DISABLE_WARN != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_warn, binlogobj>::type warn;
+#else
+		typedef nooplogobj<logtype_warn> warn;
+#endif
+
+#if SLOG_DISABLE_VERBOSE != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_verbose, binlogobj>::type verbose;
+#else
+		typedef nooplogobj<logtype_verbose> verbose;
+#endif
+
+#if SLOG_DISABLE_ERROR != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_error, binlogobj>::type error;
+#else
+		typedef nooplogobj<logtype_error> error;
+#endif
+
+#if SLOG_DISABLE_DEBUG != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_debug, binlogobj>::type debug;
+#else
+		typedef nooplogobj<logtype_debug> debug;
+#endif
+
+#if SLOG_DISABLE_SUCCESS != 1 && SLOG_DISABLE != 1
+		typedef selectlogobj<logtype_success, binlogobj>::type success;
+#else
+		typedef nooplogobj<logtype_success> success;
+#endif
+	}
+
+	// reads back what logdevice_binary_file wrote
+	class binarylogreader
+	{
+		public:
+			struct entry
+			{
+				const logtype* type;
+				std::chrono::system_clock::time_point when;
+				std::string text;	// the message of a record, or the whole line for preformatted lines
+				bool preformatted;
+			};
+
+			binarylogreader(const std::string& filename);
+
+			// false once the end of the file is reached, throws on a malformed file
+			bool next(entry& e);
+
+		private:
+			template<typename T> T read();
+			void readbytes(char* dest, size_t length);
+
+			std::string _filename;
+			std::ifstream _file;
+			std::map<uint16_t, logtype> _types;
+	};
+}
@@ -0,0 +1,66 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace slog
+{
+#if defined(_MSC_VER) && _MSC_VER <= 1600
+	enum timestampsource
+#else
+	enum class timestampsource : uint8_t
+#endif
+	{
+		systemclock,	// std::chrono::system_clock::now() for every line
+		cyclecounter,	// logclock, a counter read calibrated to the system clock
+	};
+
+	// wall time from a raw counter: the TSC on x86 when it runs at a constant rate, the monotonic clock
+	// otherwise. reading it is a counter read and a multiply-add, the system clock is only consulted when
+	// the mapping is calibrated, on first use and then every calibration interval by whichever thread
+	// finds it due.
+	//
+	// every thread uses the same continuous, increasing mapping, so timestamps never go backwards. a
+	// correction takes effect a millisecond after it is made, which is long after any thread could still
+	// be converting with the previous one. small errors are slewed out at no more than 500ppm. the system
+	// clock stepping is only believed once two calibrations in a row see it: stepping forward is then
+	// followed right away, stepping back is caught up with by running at half speed
+	class logclock
+	{
+		public:
+			static std::chrono::system_clock::time_point now();
+
+			// false when the TSC is not usable and the monotonic clock is read instead
+			static bool usestsc();
+
+			// how often the mapping is checked against the system clock, a second by default
+			static void setcalibrationinterval(std::chrono::milliseconds interval);
+	};
+}
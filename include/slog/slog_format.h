@@ -0,0 +1,529 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+
+namespace slog
+{
+	// growable char buffer that is also the streambuf behind the per-thread formatting streams. once it
+	// has grown to fit the longest line seen it stops allocating
+	class linebuffer : public std::streambuf
+	{
+		public:
+			linebuffer() { }
+
+			const char* data() const { return pbase(); }
+			size_t size() const { return pptr() - pbase(); }
+			void clear() { setp(pbase(), epptr()); }
+
+			// drops everything after the first size bytes
+			void truncate(size_t size)
+			{
+				setp(pbase(), epptr());
+				pbump((int)size);
+			}
+
+			void append(const char* text, size_t length)
+			{
+				if ((size_t)(epptr() - pptr()) < length)
+					grow(length);
+				std::char_traits<char>::copy(pptr(), text, length);
+				pbump((int)length);
+			}
+
+			void append(const std::string& text) { append(text.data(), text.size()); }
+
+			void append(char c)
+			{
+				if (pptr() == epptr())
+					grow(1);
+				*pptr() = c;
+				pbump(1);
+			}
+
+			// replaces bytes already written, used to patch in lengths once they are known
+			void overwrite(size_t pos, const char* bytes, size_t length) { std::char_traits<char>::copy(pbase() + pos, bytes, length); }
+
+			// exchanges what both buffers hold along with their storage
+			void swap(linebuffer& other)
+			{
+				std::streambuf::swap(other);
+				_storage.swap(other._storage);
+			}
+
+		protected:
+			int_type overflow(int_type ch) override;
+			std::streamsize xsputn(const char* text, std::streamsize length) override;
+
+		private:
+			void grow(size_t minfree);
+
+			std::unique_ptr<char[]> _storage;
+
+			linebuffer(const linebuffer&);
+			linebuffer& operator=(const linebuffer&);
+	};
+
+	// per-thread formatting space used by logobj instead of a fresh ostringstream per line. log statements
+	// on one thread always end in the reverse order they started (a line logged from within an operator<<
+	// finishes before the outer one), so each nesting level simply gets its own scratch
+	struct logscratch
+	{
+		logscratch() : stream(&message), recordonly(false) { }
+
+		linebuffer message;
+		linebuffer fields;
+		linebuffer line;
+		std::ostream stream;
+		bool recordonly;	// the level is off and the line is only built for the flight recorder
+
+		static logscratch& acquire();
+		static void release();
+	};
+	// formatting for the fmt front ends (see SLOG_FMT) and operator<< on logobj and strobj. the common types
+	// are written straight into the line buffer with the same output a default std::ostream would produce,
+	// anything else goes through its operator<< on the scratch stream
+	namespace textformat
+	{
+		inline const char* digitpairs()
+		{
+			static const char pairs[] =
+				"00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+			return pairs;
+		}
+
+		// writes the digits backwards ending at end, two at a time, and returns where they start
+		template<typename T>
+		inline char* formatunsigned(char* end, T value)
+		{
+			const char* pairs = digitpairs();
+			while (value >= 100)
+			{
+				const size_t i = (size_t)(value % 100) * 2;
+				value /= 100;
+				end -= 2;
+				end[0] = pairs[i];
+				end[1] = pairs[i + 1];
+			}
+
+			if (value >= 10)
+			{
+				const size_t i = (size_t)value * 2;
+				end -= 2;
+				end[0] = pairs[i];
+				end[1] = pairs[i + 1];
+			}
+			else
+				*--end = (char)('0' + value);
+
+			return end;
+		}
+
+		template<typename T>
+		inline void writeunsigned(linebuffer& out, T value)
+		{
+			char digits[24];
+			char* const end = digits + sizeof(digits);
+			char* const begin = formatunsigned(end, value);
+			out.append(begin, end - begin);
+		}
+
+		// what %g prints, which is what a default std::ostream prints: 6 significant digits, fixed notation
+		// for exponents from -4 to 5 and scientific otherwise, trailing zeros dropped. the digits come from one
+		// scaling by an exact power of ten, which is off by at most an ulp; values whose rounding that ulp could
+		// change, and the ones out of range of the table (denormals, zero, inf, nan, huge exponents) are left to
+		// snprintf. returns the length written to out, which has room for 32 chars
+		inline size_t formatdouble(char* out, double value)
+		{
+			static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+			uint64_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			const int biased = (int)((bits >> 52) & 0x7ff);
+
+			// floor(log10(2^binary)), the decimal exponent is this or one more
+			int exponent = ((biased - 1023) * 78913) >> 18;
+
+			double scaled = 0;
+			bool exact = (biased != 0 && biased != 0x7ff);
+			for (int attempt = 0; exact && attempt < 2; attempt++)
+			{
+				const int shift = 5 - exponent;
+				if (shift > 22 || shift < -22)
+					exact = false;
+				else
+				{
+					const double magnitude = (value < 0) ? -value : value;
+					scaled = (shift >= 0) ? magnitude * powers[shift] : magnitude / powers[-shift];
+					if (scaled < 1e6)
+						break;
+
+					exponent++;
+				}
+			}
+
+			uint64_t mantissa = 0;
+			if (exact)
+			{
+				mantissa = (uint64_t)scaled;
+				const double fraction = scaled - (double)mantissa;
+				if (scaled < 1e5 || scaled >= 1e6 || (fraction > 0.5 - 1e-9 && fraction < 0.5 + 1e-9))
+					exact = false;
+				else if (fraction > 0.5 && ++mantissa == 1000000)
+				{
+					mantissa = 100000;
+					exponent++;
+				}
+			}
+
+			if (exact == false)
+			{
+				const int length = std::snprintf(out, 32, "%g", value);
+				return (length < 0) ? 0 : ((length < 32) ? (size_t)length : 31);
+			}
+
+			char digits[6];
+			formatunsigned(digits + 6, mantissa);
+
+			size_t significant = 6;
+			while (significant > 1 && digits[significant - 1] == '0')
+				significant--;
+
+			char* pos = out;
+			if (value < 0)
+				*pos++ = '-';
+
+			if (exponent < -4 || exponent >= 6)
+			{
+				*pos++ = digits[0];
+				if (significant > 1)
+				{
+					*pos++ = '.';
+					std::memcpy(pos, digits + 1, significant - 1);
+					pos += significant - 1;
+				}
+
+				// the table keeps the exponent within two digits
+				const int magnitude = (exponent < 0) ? -exponent : exponent;
+				*pos++ = 'e';
+				*pos++ = (exponent < 0) ? '-' : '+';
+				*pos++ = (char)('0' + magnitude / 10);
+				*pos++ = (char)('0' + magnitude % 10);
+			}
+			else if (exponent >= 0)
+			{
+				const size_t whole = (size_t)exponent + 1;
+				std::memcpy(pos, digits, whole);
+				pos += whole;
+				if (significant > whole)
+				{
+					*pos++ = '.';
+					std::memcpy(pos, digits + whole, significant - whole);
+					pos += significant - whole;
+				}
+			}
+			else
+			{
+				*pos++ = '0';
+				*pos++ = '.';
+				for (int zeros = -exponent - 1; zeros > 0; zeros--)
+					*pos++ = '0';
+				std::memcpy(pos, digits, significant);
+				pos += significant;
+			}
+
+			return pos - out;
+		}
+
+		template<typename T>
+		inline void writearithmetic(linebuffer& out, T value, std::true_type /*signed*/, std::false_type /*floating*/)
+		{
+			typedef typename std::make_unsigned<T>::type U;
+			if (value < 0)
+			{
+				out.append('-');
+				writeunsigned(out, (U)(U(0) - (U)value));
+			}
+			else
+				writeunsigned(out, (U)value);
+		}
+
+		template<typename T>
+		inline void writearithmetic(linebuffer& out, T value, std::false_type /*signed*/, std::false_type /*floating*/)
+		{
+			writeunsigned(out, value);
+		}
+
+		template<typename T>
+		inline void writearithmetic(linebuffer& out, T value, std::true_type /*signed*/, std::true_type /*floating*/)
+		{
+			// floats are widened to double just like std::ostream does
+			char digits[32];
+			out.append(digits, formatdouble(digits, (double)value));
+		}
+
+		inline void writearithmetic(linebuffer& out, long double value, std::true_type /*signed*/, std::true_type /*floating*/)
+		{
+			char digits[64];
+			const int length = std::snprintf(digits, sizeof(digits), "%Lg", value);
+			if (length > 0)
+				out.append(digits, (size_t)length < sizeof(digits) ? (size_t)length : sizeof(digits) - 1);
+		}
+
+		inline void write(linebuffer& out, std::ostream&, bool value) { out.append(value ? '1' : '0'); }
+		inline void write(linebuffer& out, std::ostream&, char value) { out.append(value); }
+		inline void write(linebuffer& out, std::ostream&, signed char value) { out.append((char)value); }
+		inline void write(linebuffer& out, std::ostream&, unsigned char value) { out.append((char)value); }
+		// a null string is written as (null) wherever it goes, the stream would otherwise fail and drop the rest of the line
+		inline const char* nonnull(const char* value) { return value ? value : "(null)"; }
+
+		inline void write(linebuffer& out, std::ostream&, const char* value) { value = nonnull(value); out.append(value, std::strlen(value)); }
+		inline void write(linebuffer& out, std::ostream&, const std::string& value) { out.append(value); }
+
+		template<typename T>
+		inline typename std::enable_if<std::is_arithmetic<T>::value>::type write(linebuffer& out, std::ostream&, const T& value)
+		{
+			writearithmetic(out, value, std::integral_constant<bool, std::is_signed<T>::value>(), std::integral_constant<bool, std::is_floating_point<T>::value>());
+		}
+
+		template<typename T>
+		inline typename std::enable_if<!std::is_arithmetic<T>::value>::type write(linebuffer&, std::ostream& stream, const T& value)
+		{
+			stream << value;
+		}
+
+		// out is the stream's own buffer. once a manipulator (std::hex, std::setw, std::setprecision, ...) has
+		// changed the stream it formats everything itself, so the output is always what it would have been
+		inline bool isdefault(const std::ostream& stream)
+		{
+			return stream.flags() == (std::ios_base::dec | std::ios_base::skipws) && stream.width() == 0 && stream.precision() == 6;
+		}
+
+		template<typename T>
+		inline void insert(linebuffer& out, std::ostream& stream, const T& value)
+		{
+			if (isdefault(stream))
+				write(out, stream, value);
+			else
+				stream << value;
+		}
+
+		inline void insert(linebuffer& out, std::ostream& stream, const char* value)
+		{
+			value = nonnull(value);
+			if (isdefault(stream))
+				out.append(value, std::strlen(value));
+			else
+				stream << value;
+		}
+
+		// copies the literal text up to the next {} placeholder, turning {{ and }} into single braces.
+		// returns where the placeholder starts or the terminating null
+		inline const char* copyliteral(linebuffer& out, const char* format)
+		{
+			const char* run = format;
+			for (;; format++)
+			{
+				const char c = *format;
+				if (c == 0)
+					break;
+
+				if ((c == '{' || c == '}') && format[1] == c)
+				{
+					out.append(run, format + 1 - run);
+					run = ++format + 1;
+				}
+				else if (c == '{' && format[1] == '}')
+					break;
+			}
+
+			out.append(run, format - run);
+			return format;
+		}
+
+		// placeholders left over once the arguments run out are printed as they are
+		inline void formatargs(linebuffer& out, std::ostream& stream, const char* format)
+		{
+			for (;;)
+			{
+				format = copyliteral(out, format);
+				if (*format == 0)
+					return;
+
+				out.append("{}", 2);
+				format += 2;
+			}
+		}
+
+		// arguments without a placeholder are dropped, SLOG_FMT makes both of these a compile error
+		template<typename T, typename... REST>
+		inline void formatargs(linebuffer& out, std::ostream& stream, const char* format, const T& value, const REST&... rest)
+		{
+			format = copyliteral(out, format);
+			if (*format == 0)
+				return;
+
+			write(out, stream, value);
+			formatargs(out, stream, format + 2, rest...);
+		}
+
+		// the placeholders in format[begin, end) times two, plus one when the last character starts a {{, }} or {}
+		// whose second character is past end. skip is that bit of the range before. the range is split in halves
+		// so the recursion is only log(length) deep, compilers cap constexpr recursion at a few hundred levels
+		constexpr size_t scanplaceholders(const char* format, size_t begin, size_t end, size_t skip);
+
+		// left is what scanplaceholders returned for the range before middle
+		constexpr size_t joinplaceholders(size_t left, size_t right)
+		{
+			return (((left >> 1) + (right >> 1)) << 1) | (right & 1);
+		}
+
+		constexpr size_t scanafter(const char* format, size_t middle, size_t end, size_t left)
+		{
+			return joinplaceholders(left, scanplaceholders(format, middle, end, left & 1));
+		}
+
+		constexpr size_t scanplaceholders(const char* format, size_t begin, size_t end, size_t skip)
+		{
+			return (end == begin) ? skip :
+				(end - begin > 1) ? scanafter(format, begin + (end - begin) / 2, end, scanplaceholders(format, begin, begin + (end - begin) / 2, skip)) :
+				(skip != 0) ? 0 :
+				((format[begin] == '{' || format[begin] == '}') && format[begin + 1] == format[begin]) ? 1 :
+				(format[begin] == '{' && format[begin + 1] == '}') ? 3 :
+				0;
+		}
+
+		template<size_t N>
+		constexpr size_t countplaceholders(const char (&format)[N])
+		{
+			return scanplaceholders(format, 0, N - 1, 0) >> 1;
+		}
+
+		// only used in unevaluated context to count the arguments of SLOG_FMT
+		template<typename... ARGS>
+		std::integral_constant<size_t, sizeof...(ARGS)> countargs(const ARGS&...);
+	}
+
+	// the typed fields of logobj::kv, collected in logscratch::fields. a field is its key (u8 length and up to
+	// 255 bytes), a tag and the value in native byte order, strings as a u32 length and the bytes. they never
+	// leave the process in this form, logconfig::formatmsg lays them out as text, JSON or logfmt
+	namespace kvformat
+	{
+		enum tag : uint8_t
+		{
+			field_int = 'i',		// i64
+			field_uint = 'u',		// u64
+			field_double = 'd',		// f64
+			field_bool = 'b',		// u8
+			field_string = 's',		// u32 length, bytes
+		};
+
+		template<typename T>
+		inline void put(linebuffer& out, T value) { out.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+		inline void putkey(linebuffer& out, const char* key, tag t)
+		{
+			size_t length = key ? std::strlen(key) : 0;
+			if (length > 255)
+				length = 255;
+
+			out.append((char)length);
+			out.append(key, length);
+			out.append((char)t);
+		}
+
+		inline void putstring(linebuffer& out, const char* text, size_t length)
+		{
+			put<uint32_t>(out, (uint32_t)length);
+			out.append(text, length);
+		}
+
+		template<typename T>
+		inline void encodevalue(logscratch& s, const char* key, T value, std::true_type /*signed*/, std::false_type /*floating*/) { putkey(s.fields, key, field_int); put<int64_t>(s.fields, (int64_t)value); }
+
+		template<typename T>
+		inline void encodevalue(logscratch& s, const char* key, T value, std::false_type /*signed*/, std::false_type /*floating*/) { putkey(s.fields, key, field_uint); put<uint64_t>(s.fields, (uint64_t)value); }
+
+		template<typename T>
+		inline void encodevalue(logscratch& s, const char* key, T value, std::true_type /*signed*/, std::true_type /*floating*/) { putkey(s.fields, key, field_double); put<double>(s.fields, (double)value); }
+
+		inline void encode(logscratch& s, const char* key, bool value) { putkey(s.fields, key, field_bool); s.fields.append((char)(value ? 1 : 0)); }
+		inline void encode(logscratch& s, const char* key, char value) { putkey(s.fields, key, field_string); putstring(s.fields, &value, 1); }
+		inline void encode(logscratch& s, const char* key, const char* value) { putkey(s.fields, key, field_string); value = textformat::nonnull(value); putstring(s.fields, value, std::strlen(value)); }
+		inline void encode(logscratch& s, const char* key, const std::string& value) { putkey(s.fields, key, field_string); putstring(s.fields, value.data(), value.size()); }
+
+		template<typename T>
+		inline typename std::enable_if<std::is_arithmetic<T>::value>::type encode(logscratch& s, const char* key, const T& value)
+		{
+			encodevalue(s, key, value, std::integral_constant<bool, std::is_signed<T>::value>(), std::integral_constant<bool, std::is_floating_point<T>::value>());
+		}
+
+		// anything else is a string made by its operator<<, which writes to the message so it is moved over
+		template<typename T>
+		inline typename std::enable_if<!std::is_arithmetic<T>::value>::type encode(logscratch& s, const char* key, const T& value)
+		{
+			const size_t mark = s.message.size();
+			s.stream << value;
+
+			putkey(s.fields, key, field_string);
+			putstring(s.fields, s.message.data() + mark, s.message.size() - mark);
+			s.message.truncate(mark);
+		}
+	}
+}
+
+// logs a line built from a format string with one {} per argument ({{ and }} for literal braces). the
+// format string must be a literal, its placeholders are counted at compile time and checked against the
+// arguments. nothing is evaluated when the level is disabled, and compiled out levels cost nothing
+//
+//	SLOG_FMT(slog::info, "user {} took {}ms", id, ms);
+//
+#define SLOG_FMT(LOGOBJ, ...) \
+	do \
+	{ \
+		static_assert(slog::textformat::countplaceholders(SLOG_FMT_FORMAT(__VA_ARGS__)) + 1 == decltype(slog::textformat::countargs(__VA_ARGS__))::value, \
+			"SLOG_FMT: the number of {} placeholders does not match the number of arguments"); \
+		if (LOGOBJ::isenabled()) \
+			LOGOBJ::fmt(__VA_ARGS__); \
+		else \
+			LOGOBJ::filtered(); \
+	} while (0)
+
+// the format string is the first of the arguments, picking it out this way needs no empty __VA_ARGS__.
+// the extra expansion makes msvc split __VA_ARGS__ into separate arguments
+#define SLOG_FMT_EXPAND(_x) _x
+#define SLOG_FMT_FIRST(_first, ...) _first
+#define SLOG_FMT_FORMAT(...) SLOG_FMT_EXPAND(SLOG_FMT_FIRST(__VA_ARGS__, 0))
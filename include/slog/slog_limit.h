@@ -0,0 +1,266 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace slog
+{
+	// state shared by the call site limiters below: how many lines were dropped since the last report and
+	// when the next report is due. reports are made by a thread that is passing through the call site anyway,
+	// and for the counts nobody came by to report by flushreports: a statsreporter calls it on every tick, a
+	// logconfig reports everything still pending when it is destroyed and so does a limiter
+	class loglimit
+	{
+		public:
+			// logs a report of suppressed lines for the call site at file:line
+			typedef void (*reporter)(uint64_t suppressed, const char* file, int line);
+
+			explicit loglimit(std::chrono::milliseconds reportinterval);
+			~loglimit();
+
+			// reports the suppressed lines of every limiter whose report is due, or of all of them when force is set
+			static void flushreports(bool force = false);
+
+			// where and how to report, the first call site to drop a line sets it
+			void remember(reporter report, const char* file, int line)
+			{
+				if (_reporter.load(std::memory_order_relaxed) != nullptr)
+					return;
+
+				_file.store(file, std::memory_order_relaxed);
+				_line.store(line, std::memory_order_relaxed);
+				_reporter.store(report, std::memory_order_release);
+			}
+
+			static int64_t now()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+		protected:
+			// a line got through, returns the number of lines to report if a report is due
+			uint64_t passed(int64_t when)
+			{
+				if (when < _nextreport.load(std::memory_order_relaxed))
+					return 0;
+
+				return takereport(when);
+			}
+
+			// a line was dropped. without a timestamp at hand the clock is only read every 256 lines
+			uint64_t dropped(int64_t when = 0)
+			{
+				const uint64_t count = _suppressed.fetch_add(1, std::memory_order_relaxed) + 1;
+
+				if (when == 0)
+				{
+					if ((count & 255) != 0)
+						return 0;
+
+					when = now();
+				}
+
+				if (when < _nextreport.load(std::memory_order_relaxed))
+					return 0;
+
+				return takereport(when);
+			}
+
+		private:
+			// the lines to report for this limiter, what flushreports collects under its lock
+			uint64_t takepending(bool force, int64_t when) { return force ? _suppressed.exchange(0, std::memory_order_relaxed) : takereport(when); }
+
+			uint64_t takereport(int64_t when)
+			{
+				int64_t next = _nextreport.load(std::memory_order_relaxed);
+				if (when < next || _nextreport.compare_exchange_strong(next, when + _reportinterval, std::memory_order_relaxed) == false)
+					return 0;
+
+				return _suppressed.exchange(0, std::memory_order_relaxed);
+			}
+
+			std::atomic<uint64_t> _suppressed;
+			std::atomic<int64_t> _nextreport;
+			const int64_t _reportinterval;
+			std::atomic<reporter> _reporter;
+			std::atomic<const char*> _file;
+			std::atomic<int> _line;
+
+			loglimit(const loglimit&);
+			loglimit& operator=(const loglimit&);
+	};
+
+	// at most persecond lines a second with bursts of up to burst lines, a token bucket kept as the time
+	// the bucket will be full again so taking a token is a single compare and swap
+	class ratelimit : public loglimit
+	{
+		public:
+			explicit ratelimit(uint32_t persecond, uint32_t burst = 0, std::chrono::milliseconds reportinterval = std::chrono::seconds(10)) :
+				loglimit(reportinterval), _interval(1000000000 / std::max<uint32_t>(persecond, 1)),
+				_window(_interval * std::max<uint32_t>(burst ? burst : persecond, 1)), _full(0) { }
+
+			bool allow(uint64_t& report)
+			{
+				const int64_t when = now();
+				int64_t full = _full.load(std::memory_order_relaxed);
+
+				for (;;)
+				{
+					const int64_t next = std::max(full, when) + _interval;
+					if (next - when > _window)
+					{
+						report = dropped(when);
+						return false;
+					}
+
+					if (_full.compare_exchange_weak(full, next, std::memory_order_relaxed))
+						break;
+				}
+
+				report = passed(when);
+				return true;
+			}
+
+		private:
+			const int64_t _interval;
+			const int64_t _window;
+			std::atomic<int64_t> _full;
+	};
+
+	// one line out of every k
+	class samplelimit : public loglimit
+	{
+		public:
+			explicit samplelimit(uint32_t k, std::chrono::milliseconds reportinterval = std::chrono::seconds(10)) :
+				loglimit(reportinterval), _k(std::max<uint32_t>(k, 1)), _count(0) { }
+
+			bool allow(uint64_t& report)
+			{
+				if (_count.fetch_add(1, std::memory_order_relaxed) % _k != 0)
+				{
+					report = dropped();
+					return false;
+				}
+
+				report = passed(now());
+				return true;
+			}
+
+		private:
+			const uint64_t _k;
+			std::atomic<uint64_t> _count;
+	};
+
+	// the first n lines and nothing after them. once past n the check is a plain load
+	class firstlimit : public loglimit
+	{
+		public:
+			explicit firstlimit(uint64_t n, std::chrono::milliseconds reportinterval = std::chrono::seconds(10)) :
+				loglimit(reportinterval), _n(n), _count(0) { }
+
+			bool allow(uint64_t& report)
+			{
+				if (_count.load(std::memory_order_relaxed) >= _n || _count.fetch_add(1, std::memory_order_relaxed) >= _n)
+				{
+					report = dropped();
+					return false;
+				}
+
+				report = 0;
+				return true;
+			}
+
+		private:
+			const uint64_t _n;
+			std::atomic<uint64_t> _count;
+	};
+
+	// used by SLOG_LIMIT, asks the limiter once and reports dropped lines after the line that got through
+	template<typename LOGOBJ, typename LIMIT>
+	class limitpass
+	{
+		public:
+			limitpass(LIMIT& limit, const char* file, int line) : _report(0), _file(file), _line(line), pass(limit.allow(_report))
+			{
+				if (pass == false)
+				{
+					logstats::countdropped();
+					limit.remember(&report, file, line);
+				}
+			}
+
+			~limitpass()
+			{
+				if (_report)
+					report(_report, _file, _line);
+			}
+
+			static void report(uint64_t suppressed, const char* file, int line)
+			{
+				LOGOBJ() << suppressed << " lines suppressed at " << file << ":" << line;
+			}
+
+		private:
+			uint64_t _report;
+			const char* _file;
+			int _line;
+
+		public:
+			bool pass;
+	};
+}
+
+// logs the line only when the limiter lets it through, nothing right of the macro is evaluated otherwise.
+// LIMIT is a limiter that outlives the call, the macros below keep one in a static at the call site
+//
+//	static slog::ratelimit limit(10);
+//	SLOG_LIMIT(slog::warn, limit) << "queue full, dropping " << id;
+//
+#define SLOG_LIMIT(LOGOBJ, LIMIT) SLOG_LIMIT_TYPED(LOGOBJ, std::remove_reference<decltype(LIMIT)>::type, LIMIT)
+
+#define SLOG_LIMIT_TYPED(LOGOBJ, LIMITTYPE, LIMIT) \
+	if (LOGOBJ::iswritten() == false) LOGOBJ::filtered(); else \
+	for (slog::limitpass<LOGOBJ, LIMITTYPE> _slog_pass(LIMIT, __FILE__, __LINE__); _slog_pass.pass; _slog_pass.pass = false) \
+		LOGOBJ()
+
+// the lambda is only there to give every call site its own static limiter
+#define SLOG_LIMIT_AT_CALL_SITE(LOGOBJ, LIMITTYPE, ...) \
+	SLOG_LIMIT_TYPED(LOGOBJ, LIMITTYPE, ([]() -> LIMITTYPE& { static LIMITTYPE limit(__VA_ARGS__); return limit; }()))
+
+// at most PERSECOND lines a second from this call site
+#define SLOG_RATELIMIT(LOGOBJ, PERSECOND) SLOG_LIMIT_AT_CALL_SITE(LOGOBJ, slog::ratelimit, PERSECOND)
+
+// every Kth line from this call site
+#define SLOG_SAMPLE(LOGOBJ, K) SLOG_LIMIT_AT_CALL_SITE(LOGOBJ, slog::samplelimit, K)
+
+// the first N lines from this call site
+#define SLOG_FIRST(LOGOBJ, N) SLOG_LIMIT_AT_CALL_SITE(LOGOBJ, slog::firstlimit, N)
@@ -0,0 +1,59 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace slog
+{
+	// stores records from the slog::bin front ends as they were captured, plus the already formatted
+	// lines of the text front ends. see slog_binary.h for the layout and slog_decode to read it back
+	class logdevice_binary_file : logdevice
+	{
+		public:
+			logdevice_binary_file(const std::string& filename, bool bAppend = false);
+			~logdevice_binary_file();
+
+			void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+			void writerecord(const slog::logtype& type, std::chrono::system_clock::time_point when, const char* record, size_t length) override;
+
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
+
+		private:
+			uint16_t typeid_locked(const slog::logtype& type);
+
+			std::ofstream m_file;
+			std::mutex m_mutex;
+			std::vector<const logtype*> m_types;
+			linebuffer m_header;
+	};
+};
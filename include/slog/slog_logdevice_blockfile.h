@@ -0,0 +1,105 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace slog
+{
+	// block compressed log file. lines are collected into blocks of about blocksize bytes, each block is
+	// compressed with slog::lz and written behind a small header so readers can skip whole blocks:
+	//
+	//	file header:	"SLOGBLK1" u32 byteorder
+	//	block header:	u32 compressed size, u32 raw size, u32 line count, u32 zero, i64 first, i64 last (microseconds since epoch)
+	//	block data:		compressed lines, each one i64 timestamp u32 length text
+	//
+	// values are in the byte order of the writer, the reader refuses a file whose byteorder does not read
+	// back as 0x01020304. a block is written when it is full, on flush() and when the device is destroyed, so
+	// an unclean exit loses the block being filled. appending cuts off whatever follows the last complete block
+	class logdevice_blockfile : logdevice
+	{
+		public:
+			logdevice_blockfile(const std::string& filename, bool bAppend = false, size_t blocksize = 64 * 1024);
+			~logdevice_blockfile();
+
+			void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
+
+			void flush();
+
+		private:
+			void writeblock_locked();
+
+			std::ofstream m_file;
+			std::mutex m_mutex;
+			size_t m_blocksize;
+			linebuffer m_block;
+			uint32_t m_lines;
+			int64_t m_first;
+			int64_t m_last;
+			std::string m_compressed;
+	};
+
+	// reads a logdevice_blockfile file. only the block headers are read up front, a block is decompressed
+	// only when it may hold lines of the requested time range
+	class blocklogreader
+	{
+		public:
+			struct blockinfo
+			{
+				uint64_t offset;	// of the compressed data
+				uint32_t compressedsize;
+				uint32_t rawsize;
+				uint32_t lines;
+				std::chrono::system_clock::time_point first;
+				std::chrono::system_clock::time_point last;
+			};
+
+			typedef std::function<void(std::chrono::system_clock::time_point when, const std::string& line)> linefunction;
+
+			blocklogreader(const std::string& filename);
+
+			const std::vector<blockinfo>& blocks() const { return _blocks; }
+
+			// calls f for every line logged within [from, to] and returns the number of blocks decompressed
+			size_t read(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, const linefunction& f);
+
+		private:
+			std::string _filename;
+			std::ifstream _file;
+			std::vector<blockinfo> _blocks;
+	};
+};
@@ -30,14 +30,33 @@
 
 namespace slog
 {
+	// every line, color codes included, goes out in a single writev on fd 1 or 2 and does not pass through
+	// std::cout/std::cerr or their stdio buffers. colors are only used when the fd is a terminal. when stdout
+	// is a pipe or a file, stdout is flushed before each write so what printf and std::cout wrote before a
+	// line still comes out ahead of it. a program that turned off std::ios::sync_with_stdio has its own
+	// std::cout buffer and must flush it itself
 	class logdevice_console : logdevice
 	{
 		public:
 			logdevice_console();
+			~logdevice_console();
 
-			void writelogline(const logtype& type, const std::string& line) override;
+			void writelogline(const logtype& type, const char* line, size_t length) override;
+
+			// consecutive lines for the same fd go out in one writev
+			void writeloglines(const logline* lines, size_t count) override;
+
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
 
 		private:
+			bool usecolor(const logtype& type) const;
+			void flushstdio() const;
+
 			bool _xterm_console;
+			bool _stdout_tty;
+			bool _stderr_tty;
 	};
 }
\ No newline at end of file
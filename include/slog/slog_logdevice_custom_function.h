@@ -37,11 +37,30 @@ namespace slog
 		public:
 			typedef std::function<void(const logtype& ltype, const std::string& msg)> cpf;
 
+			// gets whole batches, a single line comes as a batch of one
+			typedef std::function<void(const logline* lines, size_t count)> batchpf;
+
+			// picks the batch constructor. a second std::function overload would make lambdas ambiguous on
+			// standard libraries whose std::function constructor takes any callable
+			//
+			//	slog::logdevice_custom_function sink("sink", slog::logdevice_custom_function::batches(), [](const slog::logline* lines, size_t count) { });
+			//
+			struct batches { };
+
 			logdevice_custom_function(const std::string& pfname, cpf pf);
+			logdevice_custom_function(const std::string& pfname, batches, batchpf pf);
+			~logdevice_custom_function();
+
+			virtual void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+			virtual void writeloglines(const logline* lines, size_t count) override;
 
-			virtual void writelogline(const slog::logtype& type, const std::string& line) override;
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
 
 		private:
 			cpf _pf;
+			batchpf _batchpf;
 	};
 };
\ No newline at end of file
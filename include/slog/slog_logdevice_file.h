@@ -28,18 +28,90 @@
 
 #include "slog.h"
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 namespace slog
 {
+	// lines are collected in memory and written out in one go when any of these conditions is met
+	struct fileflushpolicy
+	{
+		fileflushpolicy() : maxbuffered(64 * 1024), interval(1000), flushpriority(200) { }
+
+		size_t maxbuffered;					// bytes buffered before they are written, 0 writes every line
+		std::chrono::milliseconds interval;	// a background timer flushes at least this often, 0 disables it
+		uint32_t flushpriority;				// lines at or above this priority are written right away (200 is error)
+	};
+
+	// the log file is moved aside to filename.1, filename.2, ... when it gets too big or too old. moving it
+	// is a rename and opening a fresh file, compressing and deleting old segments happens on a background thread
+	struct filerotationpolicy
+	{
+		filerotationpolicy() : maxsize(0), interval(0), keep(10), compress(true) { }
+
+		uint64_t maxsize;				// rotate before the file grows past this many bytes, 0 disables it
+		std::chrono::seconds interval;	// rotate on every multiple of this wall clock interval, 0 disables it
+		uint32_t keep;					// rotated segments kept around, the oldest are deleted first. 0 keeps all
+		bool compress;					// gzip rotated segments to filename.N.gz, only when built with zlib
+	};
+
 	class logdevice_file : logdevice
 	{
 		public:
-			logdevice_file(const std::string& filename, bool bAppend = false);
+			logdevice_file(const std::string& filename, bool bAppend = false, const fileflushpolicy& policy = fileflushpolicy(),
+				const filerotationpolicy& rotation = filerotationpolicy());
+			~logdevice_file();
 
-			void writelogline(const slog::logtype& type, const std::string& line);
+			void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+
+			// the lines are buffered under one lock and written out together when the policy says so
+			void writeloglines(const logline* lines, size_t count) override;
+
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
+
+			// writes out whatever is buffered
+			void flush();
 
 		private:
+			// writes out the buffer, called under m_mutex
+			void flush_locked();
+			void write_locked(const linebuffer& buffer);
+			void run_timer();
+
+			// how long a rotation that failed to rename the file waits before it is tried again
+			static const std::chrono::seconds rotationretry;
+
+			bool rotation_due_locked(size_t length);
+			void rotate_locked();
+			void run_rotation();
+
+			std::string m_filename;
 			std::ofstream m_file;
+			uint64_t m_filesize;
+			fileflushpolicy m_policy;
+			linebuffer m_buffer;
+			linebuffer m_writing;	// what the timer took out of m_buffer and writes under m_writemutex only
+			std::mutex m_mutex;
+			std::mutex m_writemutex;	// taken after m_mutex, held while the file is written, rotated or closed
+			std::condition_variable m_timer;
+			std::thread m_timerthread;
+			bool m_stop;
+
+			filerotationpolicy m_rotation;
+			std::chrono::system_clock::time_point m_nextrotation;
+			uint32_t m_nextsegment;
+			std::chrono::steady_clock::time_point m_retryrotation;	// set while renaming the file fails, see rotationretry
+			std::deque<std::string> m_segments;		// rotated segments on disk, oldest first. only used by the rotation thread
+			std::deque<std::string> m_rotated;		// segments waiting to be compressed
+			std::mutex m_rotatemutex;
+			std::condition_variable m_rotatewake;
+			std::thread m_rotatethread;
+			bool m_rotatestop;
 	};
 };
\ No newline at end of file
@@ -0,0 +1,123 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#pragma once
+
+#include "slog.h"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace slog
+{
+	// keeps the most recent messages of every level in memory, including the levels that are switched off,
+	// and writes them out when a line at or above dumppriority comes along, when dump is called or when the
+	// process dies of a fatal signal (see dumponfatalsignal). while a recorder is alive lines of disabled
+	// levels are built and handed to it, but not to the devices
+	//
+	// messages are copied into a fixed ring of slots before anything is formatted, recording costs a copy
+	// and never takes a lock. the oldest records are overwritten, a message longer than a slot is cut short
+	// and its fields are left out when they do not fit. only one recorder can be alive at a time, creating
+	// a second one throws std::runtime_error
+	//
+	//	slog::logdevice_flightrecorder recorder("crash.log");
+	//	recorder.dumponfatalsignal();
+	//
+	class logdevice_flightrecorder
+	{
+		public:
+			typedef std::function<void(const logtype& ltype, const std::string& line)> dumpfunction;
+
+			// dumps are appended to filename
+			explicit logdevice_flightrecorder(const std::string& filename, size_t capacity = 4096, uint32_t dumppriority = 200);
+
+			// dumps are handed to dump a line at a time, e.g. to write them to another device
+			explicit logdevice_flightrecorder(dumpfunction dump, size_t capacity = 4096, uint32_t dumppriority = 200);
+
+			~logdevice_flightrecorder();
+
+			// writes what was recorded since the last dump, oldest first
+			void dump();
+
+#ifndef _WIN32
+			// on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT what was recorded is written to the dump file (or to
+			// stderr when dumping to a function) before the previous handler runs. only async-signal-safe calls
+			// are made, so lines are written as [epoch seconds.microseconds] - [type] - message, without fields
+			void dumponfatalsignal();
+#endif
+
+			void record(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength);
+
+			// records into the current recorder, if there is one. the caller holds a deviceregistry::reader for
+			// the duration, that is what the recorder waits for before it goes away
+			static void recordcurrent(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength);
+
+		private:
+			static const size_t slotwords = 32;
+			static const size_t headerwords = 3;
+			static const size_t slotbytes = (slotwords - headerwords) * sizeof(uint64_t);
+
+			// seq is odd while a writer is in the slot and 2 * (position + 1) once the record is complete
+			struct slot
+			{
+				std::atomic<uint64_t> seq;
+				std::atomic<uint64_t> words[slotwords];	// logtype*, nanoseconds since the epoch, lengths, message and fields
+			};
+
+			struct copied
+			{
+				const logtype* type;
+				int64_t ns;
+				uint32_t length;
+				uint32_t fieldslength;
+				uint64_t data[slotwords - headerwords];
+			};
+
+			void start(size_t capacity);
+			bool read(uint64_t position, copied& out) const;
+			void writeout(const copied& record);
+
+			static void on_fatal_signal(int signal);
+			void dump_unformatted(int fd);
+
+			std::unique_ptr<slot[]> m_slots;
+			uint64_t m_mask;
+			std::atomic<uint64_t> m_head;
+			uint32_t m_dumppriority;
+
+			std::mutex m_dumpmutex;
+			uint64_t m_dumped;		// everything before this position has been dumped
+			linebuffer m_line;
+			std::FILE* m_file;
+			dumpfunction m_dumpfunction;
+
+			logdevice_flightrecorder(const logdevice_flightrecorder&);
+			logdevice_flightrecorder& operator=(const logdevice_flightrecorder&);
+	};
+};
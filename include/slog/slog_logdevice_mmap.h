@@ -0,0 +1,63 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <mutex>
+
+namespace slog
+{
+	// writes every line with a memcpy into a shared mapping of the log file. the file is grown a chunk at
+	// a time and remapped, and cut down to the real length when the device is destroyed. if the process
+	// dies before that the kernel still has every line written so far, followed by zeroes up to the end
+	// of the last chunk. posix only
+	class logdevice_mmap : logdevice
+	{
+		public:
+			logdevice_mmap(const std::string& filename, bool bAppend = false, size_t chunksize = 4 * 1024 * 1024);
+			~logdevice_mmap();
+
+			void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
+
+		private:
+			void grow_locked(size_t minsize);
+
+			std::string m_filename;
+			std::mutex m_mutex;
+			int m_fd;
+			char* m_map;
+			size_t m_chunksize;
+			size_t m_capacity;
+			size_t m_size;
+	};
+};
@@ -0,0 +1,117 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#pragma once
+
+#include "slog.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace slog
+{
+#if defined(_MSC_VER) && _MSC_VER <= 1600
+	enum socketframing
+#else
+	enum class socketframing : uint8_t
+#endif
+	{
+		rfc5424,	// <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - line, octet counted (RFC 6587) on stream sockets
+		plain,		// the line as it is, newline terminated on stream sockets
+	};
+
+	struct socketpolicy
+	{
+		socketpolicy() : stream(false), framing(socketframing::rfc5424), buffer(false), maxbuffered(1024 * 1024), reconnect(500), facility(1) { }
+
+		bool stream;						// SOCK_STREAM instead of SOCK_DGRAM
+		socketframing framing;
+		bool buffer;						// keep what the collector could not take and send it once it is back, otherwise drop it
+		size_t maxbuffered;					// bytes kept while buffering, the oldest records go first beyond that
+		std::chrono::milliseconds reconnect;	// how long to wait between connection attempts while the collector is away
+		uint32_t facility;					// syslog facility, 1 is user
+		std::string appname;				// APP-NAME of rfc5424 records, the nil value when empty
+	};
+
+	// writes records to a local collector over a unix domain socket, e.g. /dev/log or a syslog daemon's socket.
+	// a batch from the async writer goes out in one sendmsg on stream sockets, and one sendmmsg of a
+	// datagram per record where that exists. the socket never blocks: while the collector is away, or too
+	// busy to take more, records are dropped or buffered as the policy says. a background thread sends what
+	// is buffered as soon as the collector takes it and attempts a connection again every reconnect interval,
+	// so a burst followed by silence still goes out. dropped records are counted in logstats. posix only
+	class logdevice_socket : logdevice
+	{
+		public:
+			logdevice_socket(const std::string& path, const socketpolicy& policy = socketpolicy());
+			~logdevice_socket();	// flushes what is buffered, see flush
+
+			void writelogline(const slog::logtype& type, const char* line, size_t length) override;
+			void writeloglines(const logline* lines, size_t count) override;
+
+			using logdevice::layout;
+			using logdevice::setlayout;
+			using logdevice::minpriority;
+			using logdevice::setminpriority;
+
+			bool connected() const;
+
+			// waits up to timeout for the buffered records to go out, true when nothing is left
+			bool flush(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+		private:
+			// a framed record, start is where the part still to be sent begins
+			struct record
+			{
+				std::string bytes;
+				size_t start;
+			};
+
+			void frame(const logline& line);
+			bool connect_locked();
+			void disconnect_locked();
+			void send_locked();
+			void trim_locked();
+			void run_retry();
+
+			std::string m_path;
+			socketpolicy m_policy;
+			std::string m_header;		// HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA of rfc5424 records
+
+			mutable std::mutex m_mutex;
+			int m_fd;
+			std::chrono::steady_clock::time_point m_nextattempt;
+			std::deque<record> m_pending;		// oldest first, the front may be partly sent on stream sockets
+			size_t m_pendingbytes;
+
+			std::condition_variable m_retry;		// wakes the retry thread for new records, a flush or the stop
+			std::condition_variable m_drained;		// the buffer emptied
+			std::thread m_retrythread;
+			bool m_stop;
+	};
+};
@@ -0,0 +1,53 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace slog
+{
+	// small LZ77 codec in the spirit of LZ4, tuned for the highly repetitive text of log lines. the
+	// compressed stream is a series of sequences:
+	//
+	//	token			high nibble literal count, low nibble match length - 4 (15 means more bytes follow)
+	//	[count bytes]	255 while the count keeps going, then the remainder
+	//	literals
+	//	offset			u16 little endian distance back to the match, absent for the last sequence
+	//	[length bytes]	same scheme as the literal count
+	//
+	// offsets are 16 bit, so inputs are meant to be at most 64KB
+	namespace lz
+	{
+		// appends the compressed form of input to out
+		void compress(const char* input, size_t length, std::string& out);
+
+		// appends rawlength bytes to out, false if the input is malformed
+		bool decompress(const char* input, size_t length, size_t rawlength, std::string& out);
+	}
+}
@@ -0,0 +1,93 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include "slog.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace slog
+{
+	// collapses identical consecutive messages of a log type into the first one and a "last message repeated
+	// N times" line, see logconfig::startrepeatfilter. messages are compared before the timestamp is added.
+	// the summary is written when a different message of the type comes along, when the repeats have been
+	// going on for longer than the timeout, or when the filter is stopped. the devices are written to outside
+	// the filter's lock, but every decision on a type takes a turn and the devices see a type's lines in the
+	// order they were decided on, so a summary always follows the message it counts. collapsed lines are
+	// counted in logstats
+	class repeatfilter
+	{
+		public:
+			explicit repeatfilter(std::chrono::milliseconds timeout);
+			~repeatfilter(); // writes whatever summaries are still pending
+
+			// writes the message unless it and its fields repeat the previous one, line is scratch space
+			void write(const logtype& ltype, const char* message, size_t length, const char* fields, size_t fieldslength, linebuffer& line);
+
+		private:
+			struct state
+			{
+				state() : hash(0), repeats(0), issued(0), served(0) { }
+
+				uint64_t hash;
+				std::string message;
+				std::string fields;
+				uint64_t repeats;
+				std::chrono::steady_clock::time_point firstrepeat;
+
+				// turns to write to the devices, handed out with the decisions and taken in the same order
+				uint64_t issued;
+				uint64_t served;
+				std::condition_variable turn;
+			};
+
+			// called under the lock, resets the count
+			static uint64_t take_repeats(state& s);
+
+			// waits for a turn taken under the lock, and hands it to the next one. the lock is released while waiting
+			static void wait_turn(std::unique_lock<std::mutex>& lock, state& s, uint64_t ticket);
+			void end_turn(state& s);
+
+			// writes the "last message repeated" line, called without the lock
+			static void summarize(const logtype& ltype, uint64_t repeats, linebuffer& line);
+			void run();
+
+			const std::chrono::milliseconds _timeout;
+			std::map<const logtype*, state> _states;
+			linebuffer _summary;	// scratch space of the thread writing the summaries that timed out
+			std::mutex _mutex;
+			std::condition_variable _wakeup;
+			std::thread _thread;
+			bool _stop;
+
+			repeatfilter(const repeatfilter&);
+			repeatfilter& operator=(const repeatfilter&);
+	};
+}
@@ -0,0 +1,241 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace slog
+{
+	struct logtype;
+
+	// log-linear buckets of nanoseconds: exact below 4, then four buckets per power of two, so a
+	// bucket is never wider than a quarter of the values in it
+	struct latencyhistogram
+	{
+		static const uint32_t buckets = 252;
+
+		latencyhistogram() : count(0), totalns(0)
+		{
+			for (auto& each : counts)
+				each = 0;
+		}
+
+		static uint32_t bucket(uint64_t ns)
+		{
+			if (ns < 4)
+				return (uint32_t)ns;
+
+			uint32_t msb = 63;
+			while ((ns >> msb) == 0)
+				msb--;
+
+			return (msb - 1) * 4 + (uint32_t)((ns >> (msb - 2)) & 3);
+		}
+
+		static uint64_t lowerbound(uint32_t bucket)
+		{
+			if (bucket < 4)
+				return bucket;
+
+			return (uint64_t)(4 + bucket % 4) << (bucket / 4 - 1);
+		}
+
+		// the upper edge of the bucket the p-th fraction of the samples falls in, 0 when empty
+		uint64_t percentile(double p) const
+		{
+			if (count == 0)
+				return 0;
+
+			// p = 1 is the largest sample, not one past it
+			uint64_t rank = (uint64_t)(p * count);
+			if (rank >= count)
+				rank = count - 1;
+
+			uint64_t seen = 0;
+			for (uint32_t b = 0; b < buckets; b++)
+			{
+				seen += counts[b];
+				if (seen > rank)
+					return b + 1 < buckets ? lowerbound(b + 1) - 1 : lowerbound(b);
+			}
+			return 0;
+		}
+
+		void merge(const latencyhistogram& other)
+		{
+			for (uint32_t b = 0; b < buckets; b++)
+				counts[b] += other.counts[b];
+			count += other.count;
+			totalns += other.totalns;
+		}
+
+		uint64_t counts[buckets];
+		uint64_t count;
+		uint64_t totalns;
+	};
+
+	// what a device has been handed so far, updated by whichever thread writes to it
+	class devicecounters
+	{
+		public:
+			devicecounters() : _lines(0), _bytes(0), _totalns(0)
+			{
+				for (auto& each : _buckets)
+					each.store(0, std::memory_order_relaxed);
+			}
+
+			// returns how many lines came before these
+			uint64_t countlines(uint64_t lines, size_t bytes)
+			{
+				_bytes.fetch_add(bytes, std::memory_order_relaxed);
+				return _lines.fetch_add(lines, std::memory_order_relaxed);
+			}
+
+			// samples lines that took ns each
+			void recordlatency(uint64_t ns, uint64_t samples = 1)
+			{
+				_totalns.fetch_add(ns * samples, std::memory_order_relaxed);
+				_buckets[latencyhistogram::bucket(ns)].fetch_add(samples, std::memory_order_relaxed);
+			}
+
+			// adds what was counted to lines, bytes and histogram
+			void read(uint64_t& lines, uint64_t& bytes, latencyhistogram& histogram) const
+			{
+				for (uint32_t b = 0; b < latencyhistogram::buckets; b++)
+				{
+					const uint64_t count = _buckets[b].load(std::memory_order_relaxed);
+					histogram.counts[b] += count;
+					histogram.count += count;
+				}
+				histogram.totalns += _totalns.load(std::memory_order_relaxed);
+				lines += _lines.load(std::memory_order_relaxed);
+				bytes += _bytes.load(std::memory_order_relaxed);
+			}
+
+		private:
+			std::atomic<uint64_t> _lines;
+			std::atomic<uint64_t> _bytes;
+			std::atomic<uint64_t> _totalns;
+			std::atomic<uint64_t> _buckets[latencyhistogram::buckets];
+
+			devicecounters(const devicecounters&);
+			devicecounters& operator=(const devicecounters&);
+	};
+
+	// what the library has been doing since the process started. counters are kept per thread so
+	// counting never contends, a snapshot adds up every thread (and the threads that already exited)
+	// and every device, summed by device name
+	//
+	//	auto stats = slog::logstats::snapshot();
+	//	for (auto& device : stats.devices)
+	//		printf("%s p99 %llu ns\n", device.name.c_str(), (unsigned long long)device.latency.percentile(0.99));
+	//
+	struct logstats
+	{
+		// a thread logging more than 32 types counts the rest under othertypes()
+		static const char* othertypes() { return "(other)"; }
+
+		struct typestats
+		{
+			typestats() : lines(0), bytes(0) { }
+
+			std::string name;
+			uint64_t lines;		// messages handed to the devices
+			uint64_t bytes;		// formatted, once per layout in use
+		};
+
+		struct devicestats
+		{
+			devicestats() : lines(0), bytes(0) { }
+
+			std::string name;
+			uint64_t lines;
+			uint64_t bytes;
+			latencyhistogram latency;	// of the writelogline calls that were timed, see settiming
+		};
+
+		logstats() : dropped(0), collapsed(0), filtered(0), exceptions(0) { }
+
+		std::vector<typestats> types;
+		std::vector<devicestats> devices;
+		uint64_t dropped;		// lines a call site limit or a device kept back
+		uint64_t collapsed;		// repeats the repeat filter counted in a summary instead of writing them
+		uint64_t filtered;		// lines not built because their level, category or the devices did not take them
+		uint64_t exceptions;	// caught on the way to the devices
+
+		static logstats snapshot();
+
+		// one line with the totals and the latency of each device
+		std::string summary() const;
+
+		// one in every this many writes to a device is timed (8 by default), 1 times all of them and 0 none.
+		// reading the clock twice is most of what the counting costs, the counters are always exact
+		static void settiming(uint32_t every);
+		static uint32_t timing() { return _timing.load(std::memory_order_relaxed); }
+
+		// called by the log path
+		static void countline(const logtype& ltype, size_t bytes);
+		static void countdropped();
+		static void countcollapsed();
+		static void countfiltered();
+		static void countexception();
+
+		static std::atomic<uint32_t> _timing;
+	};
+
+	// takes a snapshot every interval and hands it to report, which by default logs its summary as an info line
+	//
+	//	slog::statsreporter stats(std::chrono::minutes(1));
+	//
+	class statsreporter
+	{
+		public:
+			explicit statsreporter(std::chrono::milliseconds interval, std::function<void(const logstats&)> report = nullptr);
+			~statsreporter();
+
+		private:
+			void run();
+
+			std::chrono::milliseconds _interval;
+			std::function<void(const logstats&)> _report;
+			std::mutex _mutex;
+			std::condition_variable _wakeup;
+			std::thread _thread;
+			bool _stop;
+
+			statsreporter(const statsreporter&);
+			statsreporter& operator=(const statsreporter&);
+	};
+};
@@ -26,16 +26,25 @@
 
 #include "slog/slog.h"
 #include "slog/slog_logdevice_console.h"
+#include "slog/slog_async.h"
+#include "slog/slog_repeat.h"
+#include "slog/slog_limit.h"
+#include "slog/slog_logdevice_flightrecorder.h"
 
 #ifdef _WIN32
 #include <Windows.h>
 #endif
 
+#include <chrono>
 #include <ctime>
 #include <iostream>
-#include <iomanip>
 #include <cstdlib>
 #include <cassert>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #if _MSC_VER <= 1600
 	#pragma warning(disable:4482)
@@ -54,6 +63,7 @@ namespace slog
 /////////////////////////////////////////////////////////////////////
 
 const logconfig* logconfig::_cur_config = nullptr;
+std::atomic<logdevice_flightrecorder*> logconfig::_recorder(nullptr);
 
 static void set_logconfig_defaults(logconfig& conf)
 {
@@ -61,16 +71,19 @@ static void set_logconfig_defaults(logconfig& conf)
 	conf.print_logtype = true;
 	conf.usecolor = true;
 	conf.print_priority = false;
+	conf.timestamp_precision = timestampprecision::seconds;
+	conf.utc_timestamps = false;
+	conf.timestamp_source = timestampsource::systemclock;
 }
 
-logconfig::logconfig()
+logconfig::logconfig() : _async(nullptr), _repeats(nullptr)
 {
 	set_logconfig_defaults(*this);
 	_prev_config = _cur_config;
 	_cur_config = this;
 }
 
-logconfig::logconfig(int argc, char* argv[])
+logconfig::logconfig(int argc, char* argv[]) : _async(nullptr), _repeats(nullptr)
 {
 	set_logconfig_defaults(*this);
 	_prev_config = _cur_config;
@@ -81,12 +94,61 @@ logconfig::logconfig(int argc, char* argv[])
 
 logconfig::~logconfig()
 {
+	// pending reports and summaries still go through the async writer
+	loglimit::flushreports(true);
+	stoprepeatfilter();
+	stopasync();
 	_cur_config = _prev_config;
 }
 
-/////////////////////////////////////////////////////////////////////
+void logconfig::startasync(size_t queuecapacity)
+{
+	if (_async.load() != nullptr)
+		return;
+
+	// two threads starting at once both build a writer, the one that is not published was never seen by anyone
+	asyncwriter* async = new asyncwriter(queuecapacity);
+	asyncwriter* expected = nullptr;
+	if (_async.compare_exchange_strong(expected, async) == false)
+		delete async;
+}
+
+void logconfig::stopasync()
+{
+	asyncwriter* async = _async.exchange(nullptr);
+	if (async == nullptr)
+		return;
+
+	// a thread that loaded the writer before the exchange did so under a deviceregistry::reader, once they
+	// are gone nothing can push anymore and the asyncwriter destructor drains the queue before returning
+	deviceregistry::synchronize();
+	delete async;
+}
+
+void logconfig::startrepeatfilter(std::chrono::milliseconds timeout)
+{
+	if (_repeats.load() != nullptr)
+		return;
 
-std::map<std::string, logdevice*> logconfig::print_functions;
+	// same as startasync
+	repeatfilter* repeats = new repeatfilter(timeout);
+	repeatfilter* expected = nullptr;
+	if (_repeats.compare_exchange_strong(expected, repeats) == false)
+		delete repeats;
+}
+
+void logconfig::stoprepeatfilter()
+{
+	repeatfilter* repeats = _repeats.exchange(nullptr);
+	if (repeats == nullptr)
+		return;
+
+	// same as stopasync, the repeatfilter destructor writes the pending summaries once nobody is in write()
+	deviceregistry::synchronize();
+	delete repeats;
+}
+
+/////////////////////////////////////////////////////////////////////
 
 logdevice_console _default_console_logdevice;
 logconfig _default_logconfig;
@@ -108,6 +170,16 @@ void logconfig::parse(int argc, char* argv[])
 		if (value.length() == 0)
 			continue;
 				
+		// category:level, e.g. db.*:debug or net.http:warn
+		const size_t colon = value.rfind(':');
+		if (colon != std::string::npos)
+		{
+			uint32_t threshold;
+			if (colon > 0 && logcategory::parselevel(value.substr(colon + 1), threshold))
+				logcategory::setlevel(value.substr(0, colon), threshold);
+			continue;
+		}
+
 		const bool bEnable = (value[0] != '-');
 
 		if (value[0] == '+' || value[0] == '-')
@@ -129,64 +201,1085 @@ void logconfig::parse(int argc, char* argv[])
 			usecolor = bEnable;
 		else if (value.compare("labels") == 0 || value.compare("label") == 0)
 			print_logtype = bEnable;
+		else if (value.compare("utc") == 0 || value.compare("iso8601") == 0)
+			utc_timestamps = bEnable;
+		else if (value.compare("milliseconds") == 0 || value.compare("ms") == 0)
+			timestamp_precision = bEnable ? timestampprecision::milliseconds : timestampprecision::seconds;
+		else if (value.compare("microseconds") == 0 || value.compare("us") == 0)
+			timestamp_precision = bEnable ? timestampprecision::microseconds : timestampprecision::seconds;
 	}
 }
 
-//static
-std::string logconfig::formatmsg(const logtype& ltype, const std::string& msg)
+// writes value as exactly width digits, zero padded on the left
+static char* put_digits(char* dest, uint32_t value, uint32_t width)
 {
-	assert(_cur_config != nullptr);
+	for (uint32_t i = width; i > 0; i--)
+	{
+		dest[i - 1] = (char)('0' + value % 10);
+		value /= 10;
+	}
+	return dest + width;
+}
 
-	std::ostringstream ss;
+static void append_digits(linebuffer& out, uint32_t value, uint32_t width)
+{
+	char digits[10];
+	out.append(digits, put_digits(digits, value, width) - digits);
+}
 
-	if (_cur_config->timestamps)
+static void append_number(linebuffer& out, uint32_t value)
+{
+	char digits[10];
+	uint32_t pos = sizeof(digits);
+	do
 	{
-		tm tmstr;
-		time_t timeval;
+		digits[--pos] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	out.append(digits + pos, sizeof(digits) - pos);
+}
 
-		std::time(&timeval);
+// the date and time down to the second only change once a second, so each thread keeps the formatted
+// text of the last second it printed and only the sub-second digits are written per line
+struct timestampcache
+{
+	timestampcache() : second(-1), utc(false), length(0) { }
+
+	time_t second;
+	bool utc;
+	char text[24];
+	size_t length;
+};
+
+static thread_local timestampcache _thread_timestamp;
+
+static void format_second(timestampcache& cache, time_t second, bool utc)
+{
+	tm tmstr;
 
 #ifdef _WIN32
-		localtime_s(&tmstr, &timeval);
+	if (utc)
+		gmtime_s(&tmstr, &second);
+	else
+		localtime_s(&tmstr, &second);
 #else
-		localtime_r(&timeval, &tmstr);
+	if (utc)
+		gmtime_r(&second, &tmstr);
+	else
+		localtime_r(&second, &tmstr);
 #endif
 
-		std::ostringstream timestamp;
-		timestamp << std::setw(4) << std::setfill('0') << (1900+tmstr.tm_year) << "-";
-		timestamp << std::setw(2) << std::setfill('0') << (tmstr.tm_mon+1) << "-"; 
-		timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_mday << " ";
-		timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_hour << ":";
-		timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_min << ":";
-		timestamp << std::setw(2) << std::setfill('0') << tmstr.tm_sec;
+	char* pos = cache.text;
+	pos = put_digits(pos, 1900 + tmstr.tm_year, 4);
+	*pos++ = '-';
+	pos = put_digits(pos, tmstr.tm_mon + 1, 2);
+	*pos++ = '-';
+	pos = put_digits(pos, tmstr.tm_mday, 2);
+	*pos++ = utc ? 'T' : ' ';
+	pos = put_digits(pos, tmstr.tm_hour, 2);
+	*pos++ = ':';
+	pos = put_digits(pos, tmstr.tm_min, 2);
+	*pos++ = ':';
+	pos = put_digits(pos, tmstr.tm_sec, 2);
+
+	cache.length = pos - cache.text;
+	cache.second = second;
+	cache.utc = utc;
+}
+
+static void append_timestamp(linebuffer& out, const logconfig& config, std::chrono::system_clock::time_point when)
+{
+	const int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(when.time_since_epoch()).count();
+	int64_t second = micros / 1000000;
+	int64_t fraction = micros % 1000000;
+	if (fraction < 0)
+	{
+		second--;
+		fraction += 1000000;
+	}
+
+	timestampcache& cache = _thread_timestamp;
+	if (cache.second != (time_t)second || cache.utc != config.utc_timestamps)
+		format_second(cache, (time_t)second, config.utc_timestamps);
+
+	out.append(cache.text, cache.length);
+
+	if (config.timestamp_precision == timestampprecision::milliseconds)
+	{
+		out.append('.');
+		append_digits(out, (uint32_t)(fraction / 1000), 3);
+	}
+	else if (config.timestamp_precision == timestampprecision::microseconds)
+	{
+		out.append('.');
+		append_digits(out, (uint32_t)fraction, 6);
+	}
+
+	if (config.utc_timestamps)
+		out.append('Z');
+}
+
+//static
+std::string logconfig::formatmsg(const logtype& ltype, const std::string& msg)
+{
+	linebuffer out;
+	formatmsg(ltype, msg.data(), msg.size(), out);
+	return std::string(out.data(), out.size());
+}
+
+//static
+void logconfig::formatmsg(const logtype& ltype, const char* msg, size_t length, linebuffer& out)
+{
+	formatmsg(ltype, msg, length, out, now());
+}
+
+//static
+std::chrono::system_clock::time_point logconfig::now()
+{
+	if (_cur_config && _cur_config->timestamp_source == timestampsource::cyclecounter)
+		return logclock::now();
 
-		ss << "[" << timestamp.str() << "] - ";
+	return std::chrono::system_clock::now();
+}
+
+//static
+void logconfig::formatmsg(const logtype& ltype, const char* msg, size_t length, linebuffer& out, std::chrono::system_clock::time_point when)
+{
+	assert(_cur_config != nullptr);
+
+	out.clear();
+
+	if (_cur_config->timestamps)
+	{
+		out.append('[');
+		append_timestamp(out, *_cur_config, when);
+		out.append("] - ", 4);
 	}
 
 	if (_cur_config->print_logtype)
-		ss << "[" << ltype << "] - ";
-	
-	ss << msg;
+	{
+		out.append('[');
+		if (_cur_config->print_priority)
+		{
+			append_number(out, ltype.priority);
+			out.append('|');
+		}
+		out.append(ltype.name);
+		out.append("] - ", 4);
+	}
+
+	out.append(msg, length);
+}
+
+// one field of logscratch::fields, see kvformat
+struct kvfield
+{
+	const char* key;
+	size_t keylength;
+	uint8_t tag;
+	int64_t i;
+	uint64_t u;
+	double d;
+	const char* text;
+	size_t textlength;
+};
+
+template<typename T>
+static T read_field_value(const char*& pos)
+{
+	T value;
+	memcpy(&value, pos, sizeof(T));
+	pos += sizeof(T);
+	return value;
+}
+
+static bool next_field(const char*& pos, const char* end, kvfield& field)
+{
+	if (pos >= end)
+		return false;
+
+	field.keylength = (uint8_t)*pos++;
+	field.key = pos;
+	pos += field.keylength;
+	field.tag = (uint8_t)*pos++;
+
+	switch (field.tag)
+	{
+		case kvformat::field_int: field.i = read_field_value<int64_t>(pos); break;
+		case kvformat::field_uint: field.u = read_field_value<uint64_t>(pos); break;
+		case kvformat::field_double: field.d = read_field_value<double>(pos); break;
+		case kvformat::field_bool: field.u = (uint8_t)*pos++; break;
+		case kvformat::field_string:
+			field.textlength = read_field_value<uint32_t>(pos);
+			field.text = pos;
+			pos += field.textlength;
+			break;
+	}
+
+	return true;
+}
+
+// numbers look the same in all layouts, doubles like std::ostream prints them
+static bool append_field_number(linebuffer& out, const kvfield& field, bool json)
+{
+	switch (field.tag)
+	{
+		case kvformat::field_int: textformat::writearithmetic(out, field.i, std::true_type(), std::false_type()); return true;
+		case kvformat::field_uint: textformat::writeunsigned(out, field.u); return true;
+		case kvformat::field_bool: field.u ? out.append("true", 4) : out.append("false", 5); return true;
+		case kvformat::field_double:
+			if (json && (field.d != field.d || field.d - field.d != 0)) // JSON has no nan or inf
+				out.append("null", 4);
+			else
+				textformat::writearithmetic(out, field.d, std::true_type(), std::true_type());
+			return true;
+	}
+
+	return false;
+}
+
+static void append_json_string(linebuffer& out, const char* text, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	out.append('"');
+
+	const char* run = text;
+	const char* const end = text + length;
+	for (; text != end; text++)
+	{
+		const uint8_t c = (uint8_t)*text;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		out.append(run, text - run);
+		run = text + 1;
+
+		switch (c)
+		{
+			case '"': out.append("\\\"", 2); break;
+			case '\\': out.append("\\\\", 2); break;
+			case '\n': out.append("\\n", 2); break;
+			case '\r': out.append("\\r", 2); break;
+			case '\t': out.append("\\t", 2); break;
+			default:
+			{
+				const char escaped[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+				out.append(escaped, sizeof(escaped));
+			}
+		}
+	}
+
+	out.append(run, end - run);
+	out.append('"');
+}
+
+// logfmt values are bare unless they are empty or have spaces, quotes or = in them
+static void append_logfmt_string(linebuffer& out, const char* text, size_t length)
+{
+	bool quote = (length == 0);
+	for (size_t i = 0; i < length && quote == false; i++)
+		quote = ((uint8_t)text[i] <= ' ' || text[i] == '"' || text[i] == '=' || text[i] == '\\');
+
+	if (quote)
+		append_json_string(out, text, length);
+	else
+		out.append(text, length);
+}
+
+static void append_logfmt_fields(linebuffer& out, const char* fields, size_t fieldslength)
+{
+	const char* pos = fields;
+	kvfield field;
+	while (next_field(pos, fields + fieldslength, field))
+	{
+		out.append(' ');
+		out.append(field.key, field.keylength);
+		out.append('=');
+
+		if (append_field_number(out, field, false) == false)
+			append_logfmt_string(out, field.text, field.textlength);
+	}
+}
+
+static void format_json(const logconfig& config, const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength,
+	linebuffer& out, std::chrono::system_clock::time_point when)
+{
+	out.append('{');
+
+	if (config.timestamps)
+	{
+		out.append("\"time\":\"", 8);
+		append_timestamp(out, config, when);
+		out.append("\",", 2);
+	}
+
+	out.append("\"level\":", 8);
+	append_json_string(out, ltype.name.data(), ltype.name.size());
+	out.append(",\"msg\":", 7);
+	append_json_string(out, msg, length);
+
+	const char* pos = fields;
+	kvfield field;
+	while (next_field(pos, fields + fieldslength, field))
+	{
+		out.append(',');
+		append_json_string(out, field.key, field.keylength);
+		out.append(':');
+
+		if (append_field_number(out, field, true) == false)
+			append_json_string(out, field.text, field.textlength);
+	}
+
+	out.append('}');
+}
+
+static void format_logfmt(const logconfig& config, const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength,
+	linebuffer& out, std::chrono::system_clock::time_point when)
+{
+	if (config.timestamps)
+	{
+		// the local format has a space between date and time
+		const bool quote = (config.utc_timestamps == false);
+		out.append(quote ? "time=\"" : "time=", quote ? 6 : 5);
+		append_timestamp(out, config, when);
+		out.append(quote ? "\" " : " ", quote ? 2 : 1);
+	}
+
+	out.append("level=", 6);
+	append_logfmt_string(out, ltype.name.data(), ltype.name.size());
+	out.append(" msg=", 5);
+	append_logfmt_string(out, msg, length);
+	append_logfmt_fields(out, fields, fieldslength);
+}
+
+//static
+void logconfig::formatmsg(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength,
+	linebuffer& out, std::chrono::system_clock::time_point when, loglayout layout)
+{
+	assert(_cur_config != nullptr);
+
+	switch (layout)
+	{
+		case loglayout::json:
+			out.clear();
+			format_json(*_cur_config, ltype, msg, length, fields, fieldslength, out, when);
+			break;
+
+		case loglayout::logfmt:
+			out.clear();
+			format_logfmt(*_cur_config, ltype, msg, length, fields, fieldslength, out, when);
+			break;
+
+		default:
+			formatmsg(ltype, msg, length, out, when);
+			append_logfmt_fields(out, fields, fieldslength);
+			break;
+	}
+}
+
+static void write_to_layout(const deviceregistry::snapshot& devices, const deviceregistry::snapshot::band& band, const logtype& ltype,
+	const char* line, size_t length, loglayout layout)
+{
+	for (size_t i = 0; i < devices.devices.size(); i++)
+	{
+		if (devices.layouts[i] == layout && devices.accepts(band, i, ltype.priority))
+			devices.devices[i]->writemeasured(ltype, line, length);
+	}
+}
+
+static void dispatch_to_snapshot(const deviceregistry::snapshot* snap, asyncwriter* async, const logtype& ltype, const char* msg, size_t length,
+	const char* fields, size_t fieldslength, linebuffer& line)
+{
+	const deviceregistry::snapshot::band* band = snap ? snap->accepting(ltype.priority) : nullptr;
+	if (band == nullptr)
+	{
+		logstats::countfiltered();
+		return;
+	}
+
+	const auto when = logconfig::now();
+	size_t formatted = 0;
+
+	for (uint32_t layout = 0; layout < loglayoutcount; layout++)
+	{
+		if ((band->layoutmask & (1u << layout)) == 0)
+			continue;
+
+		logconfig::formatmsg(ltype, msg, length, fields, fieldslength, line, when, (loglayout)layout);
+		formatted += line.size();
+
+		if (async)
+			async->push(ltype, line.data(), line.size(), when, (loglayout)layout);
+		else
+			write_to_layout(*snap, *band, ltype, line.data(), line.size(), (loglayout)layout);
+	}
+
+	logstats::countline(ltype, formatted);
+}
+
+//static
+asyncwriter* logconfig::currentasync()
+{
+	return _cur_config ? _cur_config->_async.load() : nullptr;
+}
+
+//static
+void logconfig::writemessage(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength, linebuffer& line,
+	bool recordonly)
+{
+	// one pin covers the devices and the flight recorder, a recorder waits for it before it goes away
+	deviceregistry::reader devices;
+
+	if (recordonly == false)
+	{
+		repeatfilter* repeats = _cur_config ? _cur_config->_repeats.load() : nullptr;
+		if (repeats)
+			repeats->write(ltype, msg, length, fields, fieldslength, line);
+		else
+			dispatch_to_snapshot(devices.get(), currentasync(), ltype, msg, length, fields, fieldslength, line);
+	}
+
+	// after the devices, so a dump triggered by this line comes after it
+	if (recording())
+		logdevice_flightrecorder::recordcurrent(ltype, msg, length, fields, fieldslength);
+}
+
+//static
+void logconfig::dispatchmessage(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength, linebuffer& line)
+{
+	deviceregistry::reader devices;
+	dispatch_to_snapshot(devices.get(), currentasync(), ltype, msg, length, fields, fieldslength, line);
+}
+
+//static
+void logconfig::writeline(const logtype& ltype, const char* line, size_t length)
+{
+	logstats::countline(ltype, length);
+
+	// the writer is pinned by the reader, it is only deleted once the readers alive when it was unpublished are gone
+	deviceregistry::reader devices;
+	asyncwriter* async = currentasync();
+
+	if (async)
+		async->push(ltype, line, length, logconfig::now());
+	else
+		writetodevices(ltype, line, length);
+}
+
+//static
+void logconfig::writetodevices(const logtype& ltype, const char* line, size_t length, loglayout layout)
+{
+	deviceregistry::reader devices;
+	const deviceregistry::snapshot* snap = devices.get();
+	const deviceregistry::snapshot::band* band = snap ? snap->accepting(ltype.priority) : nullptr;
+
+	if (band)
+		write_to_layout(*snap, *band, ltype, line, length, layout);
+}
+
+//static
+void logconfig::writebatchtodevices(const logline* lines, size_t count, loglayout layout)
+{
+	deviceregistry::reader devices;
+	const deviceregistry::snapshot* snap = devices.get();
+	if (snap == nullptr || count == 0)
+		return;
+
+	uint32_t lowest = lines[0].type->priority;
+	for (size_t i = 1; i < count; i++)
+		lowest = std::min(lowest, lines[i].type->priority);
+
+	// the lines of a device that does not take all of them, reused by the thread
+	static thread_local std::vector<logline> taken;
+
+	for (size_t d = 0; d < snap->devices.size(); d++)
+	{
+		if (snap->layouts[d] != layout)
+			continue;
+
+		const logline* each = lines;
+		size_t taking = count;
+
+		const uint32_t minpriority = snap->minpriorities[d];
+		if (minpriority > lowest)
+		{
+			taken.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (lines[i].type->priority >= minpriority)
+					taken.push_back(lines[i]);
+			}
+
+			each = taken.data();
+			taking = taken.size();
+		}
+
+		if (taking == 0)
+			continue;
+
+		// a device that throws only loses its own copy of the batch
+		try
+		{
+			snap->devices[d]->writemeasured(each, taking);
+		}
+		catch (...)
+		{
+			logstats::countexception();
+			std::cerr << "writebatchtodevices caught an exception thrown by the writeloglines of '" << snap->devices[d]->name() << "'" << std::endl;
+		}
+	}
+}
+
+//static
+void logconfig::writerecord(const logtype& ltype, std::chrono::system_clock::time_point when, const char* record, size_t length)
+{
+	deviceregistry::reader devices;
+	const deviceregistry::snapshot* snap = devices.get();
+	const deviceregistry::snapshot::band* band = snap ? snap->accepting(ltype.priority) : nullptr;
+	if (band == nullptr)
+	{
+		logstats::countfiltered();
+		return;
+	}
+
+	for (size_t i = 0; i < snap->devices.size(); i++)
+	{
+		if (snap->accepts(*band, i, ltype.priority))
+			snap->devices[i]->writerecord(ltype, when, record, length);
+	}
+
+	logstats::countline(ltype, length);
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void linebuffer::grow(size_t minfree)
+{
+	const size_t used = size();
+	size_t capacity = (epptr() - pbase()) * 2;
+	if (capacity < 256)
+		capacity = 256;
+	while (capacity - used < minfree)
+		capacity *= 2;
+
+	std::unique_ptr<char[]> storage(new char[capacity]);
+	if (used > 0)
+		std::char_traits<char>::copy(storage.get(), pbase(), used);
 
-	return ss.str();
+	_storage = std::move(storage);
+	setp(_storage.get(), _storage.get() + capacity);
+	pbump((int)used);
+}
+
+linebuffer::int_type linebuffer::overflow(int_type ch)
+{
+	if (traits_type::eq_int_type(ch, traits_type::eof()) == false)
+		append(traits_type::to_char_type(ch));
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize linebuffer::xsputn(const char* text, std::streamsize length)
+{
+	append(text, (size_t)length);
+	return length;
+}
+
+// one scratch per nesting level of log statements on this thread, they are never freed until the thread exits
+struct threadscratch
+{
+	threadscratch() : depth(0) { }
+
+	std::vector<std::unique_ptr<logscratch>> levels;
+	size_t depth;
+};
+
+static thread_local threadscratch _thread_scratch;
+
+//static
+logscratch& logscratch::acquire()
+{
+	threadscratch& ts = _thread_scratch;
+	if (ts.depth == ts.levels.size())
+		ts.levels.emplace_back(new logscratch);
+
+	logscratch& scratch = *ts.levels[ts.depth++];
+	scratch.message.clear();
+	scratch.fields.clear();
+	scratch.recordonly = false;
+
+	// every line starts from a stream in its default state, just like a fresh ostringstream would
+	std::ostream& stream = scratch.stream;
+	stream.clear();
+	stream.flags(std::ios_base::dec | std::ios_base::skipws);
+	stream.precision(6);
+	stream.width(0);
+	stream.fill(' ');
+
+	return scratch;
+}
+
+//static
+void logscratch::release()
+{
+	_thread_scratch.depth--;
 }
 
 #pragma warning(disable:4996)
 
 /////////////////////////////////////////////////////////////////////
 
-logdevice::logdevice(std::string deviceName) : m_deviceName(std::move(deviceName))
+logdevice::logdevice(std::string deviceName, bool attachnow) : m_deviceName(std::move(deviceName)), m_attached(false), m_layout(loglayout::text), m_minpriority(0)
 {
-	_prev_device = logconfig::print_functions[m_deviceName];
-	logconfig::print_functions[m_deviceName] = this;
+	if (attachnow)
+		attach();
 }
 
 logdevice::~logdevice()
 {
-	if (_prev_device)
-		logconfig::print_functions[m_deviceName] = _prev_device;
+	detach();
+}
+
+void logdevice::attach()
+{
+	if (m_attached == false)
+	{
+		deviceregistry::add(m_deviceName, this);
+		m_attached = true;
+	}
+}
+
+void logdevice::setlayout(loglayout layout)
+{
+	m_layout = layout;
+
+	if (m_attached)
+		deviceregistry::refresh();
+}
+
+void logdevice::setminpriority(uint32_t priority)
+{
+	m_minpriority = priority;
+
+	if (m_attached)
+		deviceregistry::refresh();
+}
+
+void logdevice::writemeasured(const logtype& type, const char* line, size_t length)
+{
+	const uint64_t previous = m_counters.countlines(1, length);
+	const uint32_t every = logstats::timing();
+
+	if (every == 0 || previous % every != 0)
+	{
+		writelogline(type, line, length);
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	writelogline(type, line, length);
+	const auto took = std::chrono::steady_clock::now() - start;
+
+	m_counters.recordlatency((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+}
+
+void logdevice::writeloglines(const logline* lines, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		writelogline(*lines[i].type, lines[i].line, lines[i].length);
+}
+
+// a batch is timed as a whole and every sampled line in it gets the average
+void logdevice::writemeasured(const logline* lines, size_t count)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < count; i++)
+		bytes += lines[i].length;
+
+	const uint64_t previous = m_counters.countlines(count, bytes);
+	const uint32_t every = logstats::timing();
+	const uint64_t samples = every ? (previous + count + every - 1) / every - (previous + every - 1) / every : 0;
+
+	if (samples == 0)
+	{
+		writeloglines(lines, count);
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	writeloglines(lines, count);
+	const auto took = std::chrono::steady_clock::now() - start;
+
+	m_counters.recordlatency((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(took).count() / count, samples);
+}
+
+void logdevice::detach()
+{
+	if (m_attached)
+	{
+		m_attached = false;
+		deviceregistry::remove(m_deviceName, this);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+
+// every thread that reads the registry has a readerstate of its own, so taking a reader only writes to
+// memory no other thread writes to. a writer walks the states after publishing and waits for the ones it
+// sees inside a reader to come out
+static std::atomic<deviceregistry::snapshot*> _published_devices(nullptr);
+static std::mutex _registry_mutex;
+
+std::atomic<uint32_t> deviceregistry::_lowestpriority(0xffffffff);
+
+// name -> devices registered under it, the last one being the active one. only touched under _registry_mutex
+static std::map<std::string, std::vector<logdevice*>>& registered_devices()
+{
+	static std::map<std::string, std::vector<logdevice*>> devices;
+	return devices;
+}
+
+// name -> what devices that are gone wrote, also only touched under _registry_mutex. never freed, static
+// devices are still being removed while static destructors run
+static std::map<std::string, logstats::devicestats>& removed_devices()
+{
+	static std::map<std::string, logstats::devicestats>* devices = new std::map<std::string, logstats::devicestats>;
+	return *devices;
+}
+
+// the sequence is odd while the thread holds a reader and only the owning thread changes it. states are
+// padded so two threads never write to the same cache line, and are never freed: a thread that exits hands
+// its state to the next thread that starts logging
+struct deviceregistry::readerstate
+{
+	readerstate() : sequence(0), depth(0), inuse(true), next(nullptr) { }
+
+	std::atomic<uint64_t> sequence;
+	uint32_t depth;		// readers nested on the owning thread, only the outermost one moves the sequence
+	std::atomic<bool> inuse;
+	readerstate* next;	// set before the state is published and never changed after
+	char _pad[64];
+};
+
+static std::atomic<deviceregistry::readerstate*> _reader_states(nullptr);
+
+static thread_local deviceregistry::readerstate* _thread_reader = nullptr;
+static thread_local bool _thread_reader_released = false;
+
+// hands the state of an exiting thread back, it is marked armed when the thread takes a state so its
+// destructor runs at all. a thread that logs after this, the main thread while static destructors run,
+// takes another state and keeps it
+struct readerstaterelease
+{
+	readerstaterelease() : armed(false) { }
+
+	~readerstaterelease()
+	{
+		if (_thread_reader)
+			_thread_reader->inuse.store(false, std::memory_order_release);
+		_thread_reader = nullptr;
+		_thread_reader_released = true;
+	}
+
+	bool armed;
+};
+
+static thread_local readerstaterelease _thread_reader_release;
+
+//static
+deviceregistry::readerstate* deviceregistry::threadstate()
+{
+	if (_thread_reader)
+		return _thread_reader;
+
+	readerstate* state = nullptr;
+	for (readerstate* each = _reader_states.load(std::memory_order_acquire); each && state == nullptr; each = each->next)
+	{
+		bool inuse = false;
+		if (each->inuse.load(std::memory_order_relaxed) == false && each->inuse.compare_exchange_strong(inuse, true, std::memory_order_acquire))
+			state = each;
+	}
+
+	if (state == nullptr)
+	{
+		state = new readerstate;
+		state->next = _reader_states.load(std::memory_order_relaxed);
+		while (_reader_states.compare_exchange_weak(state->next, state, std::memory_order_release, std::memory_order_relaxed) == false)
+			;
+	}
+
+	_thread_reader = state;
+	if (_thread_reader_released == false)
+		_thread_reader_release.armed = true;
+
+	return state;
+}
+
+deviceregistry::reader::reader() : _state(threadstate())
+{
+	// the store is ordered before the load of the snapshot, so a writer that swapped the snapshot out before
+	// it either sees this thread inside or the thread sees the new snapshot
+	if (_state->depth++ == 0)
+		_state->sequence.store(_state->sequence.load(std::memory_order_relaxed) + 1);
+
+	_snap = _published_devices.load();
+}
+
+deviceregistry::reader::~reader()
+{
+	if (--_state->depth == 0)
+		_state->sequence.store(_state->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// the thread would wait for its own reader forever
+static void check_not_reading(const char* what)
+{
+	if (_thread_reader && _thread_reader->depth > 0)
+		throw std::logic_error(std::string("slog: deviceregistry::") + what + " called while the thread is writing a line");
+}
+
+// a reader that may still hold what was unpublished made its sequence odd before loading the pointer, so
+// once every state seen odd after the swap has moved on nobody can be using it anymore
+static void wait_for_readers_locked()
+{
+	for (deviceregistry::readerstate* each = _reader_states.load(std::memory_order_acquire); each; each = each->next)
+	{
+		const uint64_t seen = each->sequence.load();
+		if ((seen & 1) == 0)
+			continue;
+
+		while (each->sequence.load(std::memory_order_acquire) == seen)
+			std::this_thread::yield();
+	}
+}
+
+static void publish_devices_locked()
+{
+	deviceregistry::snapshot* next = nullptr;
+
+	auto& devices = registered_devices();
+	if (devices.empty() == false)
+	{
+		next = new deviceregistry::snapshot;
+		next->devices.reserve(devices.size());
+		next->layouts.reserve(devices.size());
+		next->minpriorities.reserve(devices.size());
+		for (auto& each : devices)
+		{
+			logdevice* device = each.second.back();
+			next->devices.push_back(device);
+			next->layouts.push_back(device->layout());
+			next->minpriorities.push_back(device->minpriority());
+		}
+
+		std::vector<uint32_t> thresholds(next->minpriorities);
+		std::sort(thresholds.begin(), thresholds.end(), std::greater<uint32_t>());
+		thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+		for (auto threshold : thresholds)
+		{
+			deviceregistry::snapshot::band band = { threshold, 0, 0 };
+			for (size_t i = 0; i < next->devices.size(); i++)
+			{
+				if (next->minpriorities[i] > threshold)
+					continue;
+
+				if (i < 64)
+					band.devicemask |= (uint64_t)1 << i;
+				band.layoutmask |= 1u << (uint32_t)next->layouts[i];
+			}
+			next->bands.push_back(band);
+		}
+	}
+
+	deviceregistry::_lowestpriority.store(next ? next->bands.back().minpriority : 0xffffffff, std::memory_order_relaxed);
+
+	deviceregistry::snapshot* prev = _published_devices.exchange(next);
+
+	wait_for_readers_locked();
+
+	delete prev;
+}
+
+//static
+void deviceregistry::synchronize()
+{
+	check_not_reading("synchronize");
+
+	std::lock_guard<std::mutex> lock(_registry_mutex);
+	wait_for_readers_locked();
+}
+
+//static
+void deviceregistry::add(const std::string& name, logdevice* device)
+{
+	check_not_reading("add");
+
+	std::lock_guard<std::mutex> lock(_registry_mutex);
+	registered_devices()[name].push_back(device);
+	publish_devices_locked();
+}
+
+//static
+void deviceregistry::remove(const std::string& name, logdevice* device)
+{
+	check_not_reading("remove");
+
+	std::lock_guard<std::mutex> lock(_registry_mutex);
+
+	auto& devices = registered_devices();
+	auto found = devices.find(name);
+	if (found == devices.end())
+		return;
+
+	auto& stack = found->second;
+	auto pos = std::find(stack.begin(), stack.end(), device);
+	if (pos == stack.end())
+		return;
+
+	stack.erase(pos);
+	if (stack.empty())
+		devices.erase(found);
+
+	publish_devices_locked();
+
+	// nobody can be writing to the device anymore, keep its counts around under its name
+	logstats::devicestats& removed = removed_devices()[name];
+	device->counters().read(removed.lines, removed.bytes, removed.latency);
+}
+
+//static
+void deviceregistry::refresh()
+{
+	check_not_reading("refresh");
+
+	std::lock_guard<std::mutex> lock(_registry_mutex);
+	publish_devices_locked();
+}
+
+//static
+void deviceregistry::readstats(std::map<std::string, logstats::devicestats>& devices)
+{
+	std::lock_guard<std::mutex> lock(_registry_mutex);
+
+	for (auto& each : removed_devices())
+	{
+		logstats::devicestats& stats = devices[each.first];
+		stats.lines += each.second.lines;
+		stats.bytes += each.second.bytes;
+		stats.latency.merge(each.second.latency);
+	}
+
+	for (auto& each : registered_devices())
+	{
+		logstats::devicestats& stats = devices[each.first];
+		for (auto device : each.second)
+			device->counters().read(stats.lines, stats.bytes, stats.latency);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+
+static std::mutex _category_mutex;
+
+// everything below is only touched under _category_mutex
+static std::map<std::string, std::unique_ptr<logcategory>>& categories()
+{
+	static std::map<std::string, std::unique_ptr<logcategory>> instance;
+	return instance;
+}
+
+// category (or "" for *) -> threshold
+static std::map<std::string, uint32_t>& category_rules()
+{
+	static std::map<std::string, uint32_t> instance;
+	return instance;
+}
+
+// the rule of the category itself, else of the closest parent that has one, else of *
+static uint32_t resolve_threshold_locked(std::string name)
+{
+	const auto& rules = category_rules();
+
+	for (;;)
+	{
+		auto found = rules.find(name);
+		if (found != rules.end())
+			return found->second;
+
+		if (name.empty())
+			return logcategory::unset;
+
+		const size_t dot = name.rfind('.');
+		name = (dot == std::string::npos) ? std::string() : name.substr(0, dot);
+	}
+}
+
+logcategory::logcategory(const std::string& name) : _name(name), _threshold(unset)
+{
+}
+
+logcategory& logcategory::get(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(_category_mutex);
+
+	std::unique_ptr<logcategory>& category = categories()[name];
+	if (category == nullptr)
+	{
+		category.reset(new logcategory(name));
+		category->_threshold.store(resolve_threshold_locked(name), std::memory_order_relaxed);
+	}
+
+	return *category;
+}
+
+void logcategory::setlevel(const std::string& pattern, uint32_t threshold)
+{
+	std::string name = pattern;
+	if (name == "*")
+		name.clear();
+	else if (name.size() > 2 && name.compare(name.size() - 2, 2, ".*") == 0)
+		name.resize(name.size() - 2);
+
+	std::lock_guard<std::mutex> lock(_category_mutex);
+
+	if (threshold == unset)
+		category_rules().erase(name);
 	else
-		logconfig::print_functions.erase(m_deviceName);
+		category_rules()[name] = threshold;
+
+	for (auto& category : categories())
+		category.second->_threshold.store(resolve_threshold_locked(category.first), std::memory_order_relaxed);
+}
+
+void logcategory::clearlevels()
+{
+	std::lock_guard<std::mutex> lock(_category_mutex);
+
+	category_rules().clear();
+
+	for (auto& category : categories())
+		category.second->_threshold.store(unset, std::memory_order_relaxed);
+}
+
+bool logcategory::parselevel(const std::string& level, uint32_t& threshold)
+{
+	if (level == "verbose" || level == "debug")
+		threshold = logtype_debug::Priority;
+	else if (level == "info")
+		threshold = logtype_info::Priority;
+	else if (level == "warn")
+		threshold = logtype_warn::Priority;
+	else if (level == "error")
+		threshold = logtype_error::Priority;
+	else if (level == "off")
+		threshold = off;
+	else if (level.empty() == false && level.find_first_not_of("0123456789") == std::string::npos)
+		threshold = (uint32_t)strtoul(level.c_str(), nullptr, 10);
+	else
+		return false;
+
+	return true;
 }
 
 /////////////////////////////////////////////////////////////////////
@@ -194,7 +1287,7 @@ logdevice::~logdevice()
 logtype_info::logtype_info()
 {
 	name = "info";
-	priority = 100;
+	priority = Priority;
 	tag = Tag;
 	color = consolecolor::white;
 }
@@ -202,7 +1295,7 @@ logtype_info::logtype_info()
 logtype_warn::logtype_warn()
 {
 	name = "warn";
-	priority = 150;
+	priority = Priority;
 	tag = Tag;
 	color = consolecolor::yellow;
 }
@@ -210,7 +1303,7 @@ logtype_warn::logtype_warn()
 logtype_error::logtype_error()
 {
 	name = "errr";
-	priority = 200;
+	priority = Priority;
 	tag = Tag;
 	usestderr = true;
 	color = consolecolor::red;
@@ -220,7 +1313,7 @@ logtype_verbose::logtype_verbose()
 {
 	enabled = false;
 	name = "verb";
-	priority = 50;
+	priority = Priority;
 	tag = Tag;
 	color = consolecolor::cyan;
 }
@@ -229,7 +1322,7 @@ logtype_debug::logtype_debug()
 {
 	enabled = false;
 	name = "debg";
-	priority = 50;
+	priority = Priority;
 	tag = Tag;
 	color = consolecolor::gray;
 }
@@ -238,7 +1331,7 @@ logtype_success::logtype_success()
 {
 	enabled = true;
 	name = "succ";
-	priority = 100;
+	priority = Priority;
 	tag = Tag;
 	color = consolecolor::green;
 }
@@ -0,0 +1,139 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_async.h"
+
+using namespace slog;
+
+asyncwriter::asyncwriter(size_t queuecapacity) : _queue(queuecapacity), _batch(batchsize), _stop(false), _sleeping(false)
+{
+	_lines.reserve(batchsize);
+	_thread = std::thread(&asyncwriter::run, this);
+}
+
+asyncwriter::~asyncwriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wakeup.notify_one();
+
+	if (_thread.joinable())
+		_thread.join();
+}
+
+void asyncwriter::push(const logtype& ltype, const char* line, size_t length, std::chrono::system_clock::time_point when, loglayout layout)
+{
+	auto fill = [&](record& rec)
+	{
+		rec.type = &ltype;
+		rec.line.assign(line, length);
+		rec.when = when;
+		rec.layout = layout;
+	};
+
+	while (_queue.trypush(fill) == false)
+		std::this_thread::yield();
+
+	// the writer sets _sleeping before it checks the queue one last time, so either it sees our record
+	// or we see the flag and wake it up
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_sleeping.load())
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_wakeup.notify_one();
+	}
+}
+
+bool asyncwriter::drain()
+{
+	bool wrote = false;
+
+	for (;;)
+	{
+		size_t count = 0;
+		while (count < batchsize && _queue.trypop(_batch[count]))
+			count++;
+
+		if (count == 0)
+			return wrote;
+
+		// a device only ever sees one layout, so the lines are split by layout and keep their order within it
+		for (uint32_t layout = 0; layout < loglayoutcount; layout++)
+		{
+			_lines.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (_batch[i].layout != (loglayout)layout)
+					continue;
+
+				logline line = { _batch[i].type, _batch[i].line.data(), _batch[i].line.size(), _batch[i].when };
+				_lines.push_back(line);
+			}
+
+			if (_lines.empty())
+				continue;
+
+			try
+			{
+				logconfig::writebatchtodevices(_lines.data(), _lines.size(), (loglayout)layout);
+			}
+			catch (...)
+			{
+				logstats::countexception();
+				std::cerr << "asyncwriter caught an exception most likely thrown by a writelogline" << std::endl;
+			}
+		}
+
+		wrote = true;
+	}
+}
+
+void asyncwriter::run()
+{
+	for (;;)
+	{
+		if (drain())
+			continue;
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_sleeping = true;
+
+		if (_stop)
+		{
+			lock.unlock();
+			drain();
+			return;
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (_queue.empty())
+			_wakeup.wait_for(lock, std::chrono::milliseconds(100));
+
+		_sleeping = false;
+	}
+}
@@ -0,0 +1,140 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_binary.h"
+
+using namespace slog;
+
+binarylogreader::binarylogreader(const std::string& filename) : _filename(filename)
+{
+	_file.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (_file.good() == false)
+		throw std::runtime_error(strobj() << "failed to open binary log file '" << filename << "' for read");
+
+	char magic[sizeof(binformat::magic)];
+	readbytes(magic, sizeof(magic));
+	if (std::memcmp(magic, binformat::magic, sizeof(magic)) != 0)
+		throw std::runtime_error(strobj() << "'" << filename << "' is not a binary slog file");
+
+	if (read<uint32_t>() != binformat::byteorder)
+		throw std::runtime_error(strobj() << "'" << filename << "' was written on a machine with a different byte order");
+}
+
+void binarylogreader::readbytes(char* dest, size_t length)
+{
+	_file.read(dest, length);
+	if ((size_t)_file.gcount() != length)
+		throw std::runtime_error(strobj() << "binary log file '" << _filename << "' is truncated");
+}
+
+template<typename T>
+T binarylogreader::read()
+{
+	T value;
+	readbytes(reinterpret_cast<char*>(&value), sizeof(value));
+	return value;
+}
+
+bool binarylogreader::next(entry& e)
+{
+	for (;;)
+	{
+		const int kind = _file.get();
+		if (kind == std::char_traits<char>::eof())
+			return false;
+
+		const uint16_t id = read<uint16_t>();
+
+		if (kind == binformat::entry_type)
+		{
+			logtype& type = _types[id];
+			type.priority = read<uint32_t>();
+			type.tag = read<uint32_t>();
+			type.color = (consolecolor)read<uint8_t>();
+			type.usestderr = read<uint8_t>() != 0;
+			type.name.resize(read<uint16_t>());
+			if (type.name.empty() == false)
+				readbytes(&type.name[0], type.name.size());
+			continue;
+		}
+
+		auto found = _types.find(id);
+		if (found == _types.end())
+			throw std::runtime_error(strobj() << "binary log file '" << _filename << "' references unknown type " << id);
+
+		e.type = &found->second;
+
+		if (kind == binformat::entry_line)
+		{
+			e.preformatted = true;
+			e.when = std::chrono::system_clock::time_point();
+			e.text.resize(read<uint32_t>());
+			if (e.text.empty() == false)
+				readbytes(&e.text[0], e.text.size());
+			return true;
+		}
+
+		if (kind != binformat::entry_record)
+			throw std::runtime_error(strobj() << "binary log file '" << _filename << "' is corrupt");
+
+		e.preformatted = false;
+		e.when = std::chrono::system_clock::time_point(std::chrono::microseconds(read<int64_t>()));
+
+		uint32_t remaining = read<uint32_t>();
+
+		// the arguments are formatted with a default stream, just like the call site would have
+		std::ostringstream ss;
+
+		while (remaining > 0)
+		{
+			const uint8_t tag = read<uint8_t>();
+			remaining -= 1;
+
+			switch (tag)
+			{
+				case binformat::arg_int: ss << read<int64_t>(); remaining -= sizeof(int64_t); break;
+				case binformat::arg_uint: ss << read<uint64_t>(); remaining -= sizeof(uint64_t); break;
+				case binformat::arg_double: ss << read<double>(); remaining -= sizeof(double); break;
+				case binformat::arg_char: ss << read<char>(); remaining -= sizeof(char); break;
+				case binformat::arg_bool: ss << (read<uint8_t>() != 0); remaining -= sizeof(uint8_t); break;
+				case binformat::arg_string:
+				{
+					std::string value(read<uint32_t>(), '\0');
+					if (value.empty() == false)
+						readbytes(&value[0], value.size());
+					ss << value;
+					remaining -= (uint32_t)(sizeof(uint32_t) + value.size());
+					break;
+				}
+				default:
+					throw std::runtime_error(strobj() << "binary log file '" << _filename << "' has an unknown argument type " << (int)tag);
+			}
+		}
+
+		e.text = ss.str();
+		return true;
+	}
+}
@@ -0,0 +1,337 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#include "slog/slog_clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define SLOG_HAVE_RDTSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SLOG_HAVE_RDTSC 1
+#endif
+
+using namespace slog;
+
+namespace
+{
+	enum counter : uint32_t
+	{
+		uncalibrated,
+		tsc,
+		monotonic,
+	};
+
+	// wall nanoseconds = basens + (ticks - basetick) * nspertick
+	struct segment
+	{
+		std::atomic<uint64_t> basetick;
+		std::atomic<int64_t> basens;
+		std::atomic<double> nspertick;
+	};
+
+	// ticks before switchtick are converted with before, the rest with after. the calibrating thread makes
+	// sequence odd while it rewrites them, readers that saw it change retry
+	struct mapping
+	{
+		std::atomic<uint32_t> sequence;
+		segment before;
+		segment after;
+		std::atomic<uint64_t> switchtick;
+	};
+
+	// only touched by the thread holding calibrating
+	struct calibration
+	{
+		uint64_t origintick;	// the rate is measured over everything since this point
+		int64_t originns;
+		double nspertick;
+		int64_t stepns;			// the first recalibrations come sooner while the rate is still rough
+		int64_t suspectns;		// an error too large to slew seen by the previous calibration, 0 when there was none
+	};
+}
+
+static std::atomic<uint32_t> _counter(uncalibrated);
+static mapping _mapping;
+static calibration _calibration;
+static std::atomic<uint64_t> _nextcalibration(0);
+static std::atomic<bool> _calibrating(false);
+static std::atomic<int64_t> _intervalns(1000000000);
+
+static const int64_t switchdelayns = 1000000;
+static const int64_t jumpns = 1000000;
+
+// a sample is the narrowest of this many reads, and none is used if even that took longer than maxwindowns
+static const int samplereads = 5;
+static const int64_t maxwindowns = 20000;
+
+// the most a correction may speed up or slow down the clock, the same bound adjtime slews at
+static const double maxslew = 0.0005;
+
+static bool tsc_is_invariant()
+{
+#if defined(SLOG_HAVE_RDTSC) && defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0x80000000);
+	if ((unsigned)regs[0] < 0x80000007)
+		return false;
+	__cpuid(regs, 0x80000007);
+	return (regs[3] & (1 << 8)) != 0;
+#elif defined(SLOG_HAVE_RDTSC)
+	unsigned int a, b, c, d;
+	if (__get_cpuid(0x80000007, &a, &b, &c, &d) == 0)
+		return false;
+	return (d & (1u << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+static uint64_t read_counter(uint32_t c)
+{
+#ifdef SLOG_HAVE_RDTSC
+	if (c == tsc)
+		return __rdtsc();
+#endif
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t wall_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// the counter value halfway through reading the system clock, from the narrowest of a few reads so a thread
+// preempted in between does not skew it. returns the width of that window in ticks
+static uint64_t sample(uint32_t c, uint64_t& tick, int64_t& ns)
+{
+	uint64_t window = UINT64_MAX;
+	for (int i = 0; i < samplereads; i++)
+	{
+		const uint64_t first = read_counter(c);
+		const int64_t wall = wall_ns();
+		const uint64_t last = read_counter(c);
+
+		if (last - first < window)
+		{
+			window = last - first;
+			tick = first + window / 2;
+			ns = wall;
+		}
+	}
+	return window;
+}
+
+static int64_t convert(const segment& s, uint64_t tick)
+{
+	// a tick read a few cycles ahead of its segment being published comes out slightly negative
+	const int64_t delta = (int64_t)(tick - s.basetick.load(std::memory_order_relaxed));
+	return s.basens.load(std::memory_order_relaxed) + (int64_t)((double)delta * s.nspertick.load(std::memory_order_relaxed));
+}
+
+static void set_segment(segment& s, uint64_t tick, int64_t ns, double nspertick)
+{
+	s.basetick.store(tick, std::memory_order_relaxed);
+	s.basens.store(ns, std::memory_order_relaxed);
+	s.nspertick.store(nspertick, std::memory_order_relaxed);
+}
+
+static uint64_t ticks_in(int64_t ns, double nspertick)
+{
+	return (uint64_t)((double)ns / nspertick);
+}
+
+static void calibrate_first()
+{
+	static std::mutex first;
+	std::lock_guard<std::mutex> lock(first);
+
+	if (_counter.load(std::memory_order_acquire) != uncalibrated)
+		return;
+
+	const uint32_t c = tsc_is_invariant() ? tsc : monotonic;
+
+	// the rate over a couple of milliseconds is good to a few parts in 100000, recalibrating refines it
+	uint64_t starttick, tick;
+	int64_t startns, ns;
+	sample(c, starttick, startns);
+	do
+	{
+		sample(c, tick, ns);
+	} while (ns - startns < 2000000 || tick == starttick);
+
+	const double nspertick = (double)(ns - startns) / (double)(tick - starttick);
+
+	_calibration.origintick = starttick;
+	_calibration.originns = startns;
+	_calibration.nspertick = nspertick;
+	_calibration.stepns = 10000000;
+	_calibration.suspectns = 0;
+
+	set_segment(_mapping.before, tick, ns, nspertick);
+	set_segment(_mapping.after, tick, ns, nspertick);
+	_mapping.switchtick.store(tick, std::memory_order_relaxed);
+	_nextcalibration.store(tick + ticks_in(std::min(_calibration.stepns, _intervalns.load(std::memory_order_relaxed)), nspertick), std::memory_order_relaxed);
+
+	_counter.store(c, std::memory_order_release);
+}
+
+static void recalibrate(uint32_t c)
+{
+	if (_calibrating.exchange(true, std::memory_order_acquire))
+		return;
+
+	const uint64_t switchtick = _mapping.switchtick.load(std::memory_order_relaxed);
+	const double delay = (double)switchdelayns / _calibration.nspertick;
+
+	// odd before sampling, so whoever converted with the old mapping read the counter before tick
+	const uint32_t sequence = _mapping.sequence.load(std::memory_order_relaxed);
+	_mapping.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint64_t tick;
+	int64_t ns;
+	const uint64_t window = sample(c, tick, ns);
+
+	// the previous correction is still pending
+	if (tick < switchtick + (uint64_t)delay)
+	{
+		_mapping.sequence.store(sequence + 2, std::memory_order_release);
+		_calibrating.store(false, std::memory_order_release);
+		return;
+	}
+
+	// the system clock could not be read without being interrupted, try again shortly
+	if ((double)window * _calibration.nspertick > (double)maxwindowns)
+	{
+		_mapping.sequence.store(sequence + 2, std::memory_order_release);
+		_nextcalibration.store(tick + (uint64_t)delay, std::memory_order_relaxed);
+		_calibrating.store(false, std::memory_order_release);
+		return;
+	}
+
+	// the rate over the whole run, unless the system clock was stepped in between
+	double nspertick = (double)(ns - _calibration.originns) / (double)(tick - _calibration.origintick);
+	if (nspertick < _calibration.nspertick * 0.999 || nspertick > _calibration.nspertick * 1.001)
+	{
+		nspertick = _calibration.nspertick;
+		_calibration.origintick = tick;
+		_calibration.originns = ns;
+	}
+	_calibration.nspertick = nspertick;
+
+	// continue the current mapping up to the switch and aim for the system clock one interval later
+	const uint64_t nextswitch = tick + (uint64_t)delay;
+	const int64_t atswitch = convert(_mapping.after, nextswitch);
+	const int64_t target = ns + (int64_t)((double)(nextswitch - tick) * nspertick);
+	const int64_t interval = std::min(_calibration.stepns, _intervalns.load(std::memory_order_relaxed));
+	_calibration.stepns = std::min(_calibration.stepns * 2, _intervalns.load(std::memory_order_relaxed));
+
+	// an error too large to slew is only acted on once the next calibration sees it too, a single odd
+	// sample is not a change of the system clock
+	const int64_t error = target - atswitch;
+	const bool large = error > jumpns || error < -jumpns;
+	const bool confirmed = large && _calibration.suspectns != 0 && std::abs(error - _calibration.suspectns) <= jumpns;
+	_calibration.suspectns = (large && confirmed == false) ? error : 0;
+
+	int64_t basens = atswitch;
+	double rate = nspertick;
+	if (confirmed && error > 0)
+		basens = target;
+	else if (confirmed)
+		rate = nspertick / 2;
+	else if (large == false)
+		rate = nspertick * (1.0 + std::max(-maxslew, std::min(maxslew, (double)error / (double)interval)));
+
+	set_segment(_mapping.before, _mapping.after.basetick.load(std::memory_order_relaxed), _mapping.after.basens.load(std::memory_order_relaxed),
+		_mapping.after.nspertick.load(std::memory_order_relaxed));
+	set_segment(_mapping.after, nextswitch, basens, rate);
+	_mapping.switchtick.store(nextswitch, std::memory_order_relaxed);
+
+	_mapping.sequence.store(sequence + 2, std::memory_order_release);
+
+	_nextcalibration.store(tick + ticks_in(interval, nspertick), std::memory_order_relaxed);
+	_calibrating.store(false, std::memory_order_release);
+}
+
+//static
+std::chrono::system_clock::time_point logclock::now()
+{
+	uint32_t c = _counter.load(std::memory_order_acquire);
+	if (c == uncalibrated)
+	{
+		calibrate_first();
+		c = _counter.load(std::memory_order_acquire);
+	}
+
+	uint64_t tick;
+	int64_t ns;
+	for (;;)
+	{
+		const uint32_t sequence = _mapping.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		tick = read_counter(c);
+		ns = convert(tick < _mapping.switchtick.load(std::memory_order_relaxed) ? _mapping.before : _mapping.after, tick);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (_mapping.sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+
+	if (tick >= _nextcalibration.load(std::memory_order_relaxed))
+		recalibrate(c);
+
+	return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+//static
+bool logclock::usestsc()
+{
+	if (_counter.load(std::memory_order_acquire) == uncalibrated)
+		calibrate_first();
+
+	return _counter.load(std::memory_order_relaxed) == tsc;
+}
+
+//static
+void logclock::setcalibrationinterval(std::chrono::milliseconds interval)
+{
+	_intervalns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count(), std::memory_order_relaxed);
+	_nextcalibration.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_limit.h"
+
+#include <mutex>
+#include <vector>
+
+using namespace slog;
+
+// every limiter alive, only touched under the mutex. never freed, static limiters at call sites are still
+// being destroyed while static destructors run
+struct limitregistry
+{
+	std::mutex mutex;
+	std::vector<loglimit*> limits;
+};
+
+static limitregistry& registered_limits()
+{
+	static limitregistry* registry = new limitregistry;
+	return *registry;
+}
+
+loglimit::loglimit(std::chrono::milliseconds reportinterval) :
+	_suppressed(0), _nextreport(0), _reportinterval(std::chrono::duration_cast<std::chrono::nanoseconds>(reportinterval).count()),
+	_reporter(nullptr), _file(nullptr), _line(0)
+{
+	limitregistry& registry = registered_limits();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.limits.push_back(this);
+}
+
+loglimit::~loglimit()
+{
+	{
+		limitregistry& registry = registered_limits();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.limits.erase(std::find(registry.limits.begin(), registry.limits.end(), this));
+	}
+
+	const uint64_t suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+	reporter report = _reporter.load(std::memory_order_acquire);
+
+	if (suppressed && report)
+		report(suppressed, _file.load(std::memory_order_relaxed), _line.load(std::memory_order_relaxed));
+}
+
+//static
+void loglimit::flushreports(bool force)
+{
+	struct pending
+	{
+		reporter report;
+		const char* file;
+		int line;
+		uint64_t suppressed;
+	};
+
+	// the reports are logged after the lock is released, a device may well use a limiter of its own
+	std::vector<pending> reports;
+	{
+		const int64_t when = now();
+
+		limitregistry& registry = registered_limits();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		for (auto limit : registry.limits)
+		{
+			const reporter report = limit->_reporter.load(std::memory_order_acquire);
+			if (report == nullptr || limit->_suppressed.load(std::memory_order_relaxed) == 0)
+				continue;
+
+			const uint64_t suppressed = limit->takepending(force, when);
+			if (suppressed)
+			{
+				pending each = { report, limit->_file.load(std::memory_order_relaxed), limit->_line.load(std::memory_order_relaxed), suppressed };
+				reports.push_back(each);
+			}
+		}
+	}
+
+	for (auto& each : reports)
+		each.report(each.suppressed, each.file, each.line);
+}
@@ -0,0 +1,113 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_logdevice_binary_file.h"
+#include "slog/slog_binary.h"
+
+#include <algorithm>
+
+using namespace slog;
+
+logdevice_binary_file::logdevice_binary_file(const std::string& filename, bool bAppend) : logdevice("logdevice_binary_file", false)
+{
+	bool bWriteHeader = true;
+	if (bAppend)
+	{
+		std::ifstream existing(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+		bWriteHeader = (existing.good() == false || existing.tellg() <= 0);
+	}
+
+	auto mode = (bAppend) ? (std::ios::out | std::ios::binary | std::ios::app) : (std::ios::out | std::ios::binary);
+	m_file.open(filename.c_str(), mode);
+	if (m_file.good() == false)
+		throw std::runtime_error(strobj() << "failed to open binary log file '" << filename << "' for write");
+
+	if (bWriteHeader)
+	{
+		m_file.write(binformat::magic, sizeof(binformat::magic));
+		m_file.write(reinterpret_cast<const char*>(&binformat::byteorder), sizeof(binformat::byteorder));
+	}
+
+	attach();
+}
+
+logdevice_binary_file::~logdevice_binary_file()
+{
+	detach();
+}
+
+// type ids are assigned per file, the type entry is written the first time a type shows up
+uint16_t logdevice_binary_file::typeid_locked(const logtype& type)
+{
+	auto found = std::find(m_types.begin(), m_types.end(), &type);
+	if (found != m_types.end())
+		return (uint16_t)(found - m_types.begin());
+
+	const uint16_t id = (uint16_t)m_types.size();
+	m_types.push_back(&type);
+
+	m_header.clear();
+	binformat::put<uint8_t>(m_header, binformat::entry_type);
+	binformat::put<uint16_t>(m_header, id);
+	binformat::put<uint32_t>(m_header, type.priority);
+	binformat::put<uint32_t>(m_header, type.tag);
+	binformat::put<uint8_t>(m_header, (uint8_t)type.color);
+	binformat::put<uint8_t>(m_header, type.usestderr ? 1 : 0);
+	binformat::put<uint16_t>(m_header, (uint16_t)type.name.size());
+	m_header.append(type.name);
+	m_file.write(m_header.data(), m_header.size());
+
+	return id;
+}
+
+void logdevice_binary_file::writelogline(const logtype& type, const char* line, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const uint16_t id = typeid_locked(type);
+
+	m_header.clear();
+	binformat::put<uint8_t>(m_header, binformat::entry_line);
+	binformat::put<uint16_t>(m_header, id);
+	binformat::put<uint32_t>(m_header, (uint32_t)length);
+	m_file.write(m_header.data(), m_header.size());
+	m_file.write(line, length);
+}
+
+void logdevice_binary_file::writerecord(const logtype& type, std::chrono::system_clock::time_point when, const char* record, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const uint16_t id = typeid_locked(type);
+
+	m_header.clear();
+	binformat::put<uint8_t>(m_header, binformat::entry_record);
+	binformat::put<uint16_t>(m_header, id);
+	binformat::put<int64_t>(m_header, std::chrono::duration_cast<std::chrono::microseconds>(when.time_since_epoch()).count());
+	binformat::put<uint32_t>(m_header, (uint32_t)length);
+	m_file.write(m_header.data(), m_header.size());
+	m_file.write(record, length);
+}
@@ -0,0 +1,290 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_logdevice_blockfile.h"
+#include "slog/slog_lz.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace slog;
+
+static const char blockfile_magic[8] = { 'S', 'L', 'O', 'G', 'B', 'L', 'K', '1' };
+static const uint32_t blockfile_byteorder = 0x01020304;
+static const uint64_t blockfile_headersize = sizeof(blockfile_magic) + sizeof(blockfile_byteorder);
+
+struct blockheader
+{
+	uint32_t compressedsize;
+	uint32_t rawsize;
+	uint32_t lines;
+	uint32_t reserved;
+	int64_t first;
+	int64_t last;
+};
+
+static int64_t to_microseconds(std::chrono::system_clock::time_point when)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(when.time_since_epoch()).count();
+}
+
+static std::chrono::system_clock::time_point from_microseconds(int64_t micros)
+{
+	return std::chrono::system_clock::time_point(std::chrono::microseconds(micros));
+}
+
+static void check_fileheader(std::istream& in, const std::string& filename)
+{
+	char magic[sizeof(blockfile_magic)];
+	uint32_t byteorder = 0;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(&byteorder), sizeof(byteorder));
+
+	if (in.good() == false || std::memcmp(magic, blockfile_magic, sizeof(magic)) != 0)
+		throw std::runtime_error(strobj() << "'" << filename << "' is not a block log file");
+	if (byteorder != blockfile_byteorder)
+		throw std::runtime_error(strobj() << "'" << filename << "' was written on a machine with a different byte order");
+}
+
+// the length of an existing file up to the end of its last complete block, 0 when it has no complete header
+static uint64_t complete_length(const std::string& filename)
+{
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (in.good() == false)
+		return 0;
+
+	const uint64_t size = (uint64_t)in.tellg();
+	if (size < blockfile_headersize)
+		return 0;
+
+	in.seekg(0);
+	check_fileheader(in, filename);
+
+	uint64_t end = blockfile_headersize;
+	for (;;)
+	{
+		blockheader header;
+		in.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (in.good() == false || end + sizeof(header) + header.compressedsize > size)
+			return end;
+
+		end += sizeof(header) + header.compressedsize;
+		in.seekg((std::streamoff)end);
+	}
+}
+
+static bool truncate_file(const std::string& filename, uint64_t size)
+{
+#ifdef _WIN32
+	int fd = -1;
+	if (_sopen_s(&fd, filename.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0)
+		return false;
+	const bool truncated = (_chsize_s(fd, (__int64)size) == 0);
+	_close(fd);
+	return truncated;
+#else
+	return truncate(filename.c_str(), (off_t)size) == 0;
+#endif
+}
+
+logdevice_blockfile::logdevice_blockfile(const std::string& filename, bool bAppend, size_t blocksize) : logdevice("logdevice_blockfile", false),
+	m_blocksize(blocksize), m_lines(0), m_first(0), m_last(0)
+{
+	// a block torn by an unclean exit is cut off, the reader would otherwise stop at it
+	bool bWriteHeader = true;
+	if (bAppend)
+	{
+		const uint64_t length = complete_length(filename);
+		if (truncate_file(filename, length) == false && length > 0)
+			throw std::runtime_error(strobj() << "failed to cut block log file '" << filename << "' back to its last complete block");
+		bWriteHeader = (length == 0);
+	}
+
+	auto mode = (bAppend) ? (std::ios::out | std::ios::binary | std::ios::app) : (std::ios::out | std::ios::binary);
+	m_file.open(filename.c_str(), mode);
+	if (m_file.good() == false)
+		throw std::runtime_error(strobj() << "failed to open block log file '" << filename << "' for write");
+
+	if (bWriteHeader)
+	{
+		m_file.write(blockfile_magic, sizeof(blockfile_magic));
+		m_file.write(reinterpret_cast<const char*>(&blockfile_byteorder), sizeof(blockfile_byteorder));
+	}
+
+	attach();
+}
+
+logdevice_blockfile::~logdevice_blockfile()
+{
+	detach();
+	flush();
+}
+
+void logdevice_blockfile::writelogline(const logtype&, const char* line, size_t length)
+{
+	const int64_t now = to_microseconds(std::chrono::system_clock::now());
+	const uint32_t linelength = (uint32_t)length;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_lines == 0 || now < m_first)
+		m_first = now;
+	if (m_lines == 0 || now > m_last)
+		m_last = now;
+
+	m_block.append(reinterpret_cast<const char*>(&now), sizeof(now));
+	m_block.append(reinterpret_cast<const char*>(&linelength), sizeof(linelength));
+	m_block.append(line, length);
+	m_lines++;
+
+	if (m_block.size() >= m_blocksize)
+		writeblock_locked();
+}
+
+void logdevice_blockfile::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	writeblock_locked();
+	m_file.flush();
+}
+
+void logdevice_blockfile::writeblock_locked()
+{
+	if (m_lines == 0)
+		return;
+
+	m_compressed.clear();
+	lz::compress(m_block.data(), m_block.size(), m_compressed);
+
+	blockheader header;
+	header.compressedsize = (uint32_t)m_compressed.size();
+	header.rawsize = (uint32_t)m_block.size();
+	header.lines = m_lines;
+	header.reserved = 0;
+	header.first = m_first;
+	header.last = m_last;
+
+	m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	m_file.write(m_compressed.data(), m_compressed.size());
+
+	m_block.clear();
+	m_lines = 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+blocklogreader::blocklogreader(const std::string& filename) : _filename(filename)
+{
+	_file.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (_file.good() == false)
+		throw std::runtime_error(strobj() << "failed to open block log file '" << filename << "' for read");
+
+	check_fileheader(_file, filename);
+
+	// hop from header to header, the block data is not read here
+	for (;;)
+	{
+		blockheader header;
+		_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (_file.gcount() == 0)
+			break;
+		if (_file.gcount() != sizeof(header))
+			throw std::runtime_error(strobj() << "block log file '" << filename << "' is truncated");
+
+		blockinfo info;
+		info.offset = (uint64_t)_file.tellg();
+		info.compressedsize = header.compressedsize;
+		info.rawsize = header.rawsize;
+		info.lines = header.lines;
+		info.first = from_microseconds(header.first);
+		info.last = from_microseconds(header.last);
+		_blocks.push_back(info);
+
+		_file.seekg(header.compressedsize, std::ios::cur);
+	}
+
+	_file.clear();
+}
+
+size_t blocklogreader::read(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to, const linefunction& f)
+{
+	size_t decompressed = 0;
+	std::string compressed;
+	std::string raw;
+	std::string line;
+
+	for (auto& block : _blocks)
+	{
+		if (block.last < from || block.first > to)
+			continue;
+
+		compressed.resize(block.compressedsize);
+		_file.clear();
+		_file.seekg((std::streamoff)block.offset);
+		if (block.compressedsize > 0)
+			_file.read(&compressed[0], block.compressedsize);
+		if ((uint32_t)_file.gcount() != block.compressedsize)
+			throw std::runtime_error(strobj() << "block log file '" << _filename << "' is truncated");
+
+		raw.clear();
+		if (lz::decompress(compressed.data(), compressed.size(), block.rawsize, raw) == false)
+			throw std::runtime_error(strobj() << "block log file '" << _filename << "' has a corrupt block at " << block.offset);
+
+		decompressed++;
+
+		size_t pos = 0;
+		while (pos + sizeof(int64_t) + sizeof(uint32_t) <= raw.size())
+		{
+			int64_t when;
+			uint32_t length;
+			std::memcpy(&when, raw.data() + pos, sizeof(when));
+			std::memcpy(&length, raw.data() + pos + sizeof(when), sizeof(length));
+			pos += sizeof(when) + sizeof(length);
+
+			if (pos + length > raw.size())
+				throw std::runtime_error(strobj() << "block log file '" << _filename << "' has a corrupt block at " << block.offset);
+
+			const auto time = from_microseconds(when);
+			if (time >= from && time <= to)
+			{
+				line.assign(raw.data() + pos, length);
+				f(time, line);
+			}
+
+			pos += length;
+		}
+	}
+
+	return decompressed;
+}
@@ -35,9 +35,16 @@
 
 #ifdef _WIN32
 #include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
 #endif
 
 #include <iostream>
+#include <cstdio>
+#include <cstring>
 
 using namespace slog;
 
@@ -77,7 +84,62 @@ static const char* XTermColorSequence(consolecolor col)
 	return "\x1B[0m";
 }
 
-logdevice_console::logdevice_console() : logdevice("console")
+#ifndef _WIN32
+static const char CC_REMOVE[] = "\x1B[0m\n";
+
+// the color sequence, the line and the newline (or the sequence that resets the color and a newline)
+static int line_iovecs(iovec* iov, const logtype& type, const char* line, size_t length, bool color)
+{
+	int count = 0;
+
+	if (color)
+	{
+		const char* sequence = XTermColorSequence(type.color);
+		iov[count].iov_base = (void*)sequence;
+		iov[count++].iov_len = strlen(sequence);
+	}
+
+	iov[count].iov_base = (void*)line;
+	iov[count++].iov_len = length;
+
+	iov[count].iov_base = (void*)(color ? CC_REMOVE : CC_REMOVE + sizeof(CC_REMOVE) - 2);
+	iov[count++].iov_len = color ? sizeof(CC_REMOVE) - 1 : 1;
+
+	return count;
+}
+
+// normally a single writev, another one is only needed after a short write or a signal
+static void writeall(int fd, iovec* iov, int count)
+{
+	while (count > 0)
+	{
+		const ssize_t written = writev(fd, iov, count);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return; // nowhere left to complain to
+		}
+
+		size_t left = (size_t)written;
+		while (count > 0 && left >= iov->iov_len)
+		{
+			left -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count > 0)
+		{
+			iov->iov_base = (char*)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
+}
+#endif
+
+logdevice_console::logdevice_console() : logdevice("console", false)
 {
 	// figuring out the terminal is not easy and is very error prone - keep it simple for now
 	// for example you can launch a %comspec% terminal from a mintty terminal and the %comspec% will have the environment variable TERM set to xterm
@@ -92,38 +154,110 @@ logdevice_console::logdevice_console() : logdevice("console")
 	// console and has the environment variable still set, but the console wont recognize xterm ansi colors
 	if (IsDebuggerPresent())
 		_xterm_console = false;
+
+	_stdout_tty = _isatty(1) != 0;
+	_stderr_tty = _isatty(2) != 0;
+#else
+	// redirected to a file or a pipe, escape codes would only be garbage in there
+	_stdout_tty = isatty(1) != 0;
+	_stderr_tty = isatty(2) != 0;
 #endif
+
+	attach();
 }
 
-void logdevice_console::writelogline(const logtype& type, const std::string& line)
+logdevice_console::~logdevice_console()
 {
+	detach();
+}
+
+bool logdevice_console::usecolor(const logtype& type) const
+{
+	const bool tty = type.usestderr ? _stderr_tty : _stdout_tty;
+	return logconfig::_cur_config->usecolor && _xterm_console && tty;
+}
+
+#ifndef _WIN32
+// a terminal gets stdout a line at a time, a pipe or a file only once the buffer fills up. what the program
+// printed before the line has to get there first
+void logdevice_console::flushstdio() const
+{
+	if (_stdout_tty == false)
+		fflush(stdout);
+}
+#endif
+
+void logdevice_console::writelogline(const logtype& type, const char* line, size_t length)
+{
+#ifndef _WIN32
+	flushstdio();
+
+	iovec iov[3];
+	writeall(type.usestderr ? 2 : 1, iov, line_iovecs(iov, type, line, length, usecolor(type)));
+#else
 	std::ostream& out = type.usestderr ? std::cerr : std::cout;
 
 	if (logconfig::_cur_config->usecolor == false)
 	{
-		out << line << std::endl;
+		out.write(line, length);
+		out << std::endl;
 		return;
 	}
 
-	if (_xterm_console)
+	if (_xterm_console && (type.usestderr ? _stderr_tty : _stdout_tty))
 	{
 		static const char* CC_REMOVE = "\x1B[0m";
-		out << XTermColorSequence(type.color) << line << CC_REMOVE << std::endl;
+		out << XTermColorSequence(type.color);
+		out.write(line, length);
+		out << CC_REMOVE << std::endl;
 	}
-#ifdef _WIN32
 	else
 	{
 		HANDLE hstdout = GetStdHandle(STD_OUTPUT_HANDLE);
 		CONSOLE_SCREEN_BUFFER_INFO csbi;
 		GetConsoleScreenBufferInfo(hstdout, &csbi);
 		SetConsoleTextAttribute(hstdout, ConvertToOSSpecificValue(type.color));
-		out << line << std::endl;
+		out.write(line, length);
+		out << std::endl;
 		SetConsoleTextAttribute(hstdout, csbi.wAttributes);
 	}
-#else
-	else
+#endif
+}
+
+void logdevice_console::writeloglines(const logline* lines, size_t count)
+{
+#ifndef _WIN32
+	// stays well below IOV_MAX
+	const size_t maxlines = 128;
+	iovec iov[maxlines * 3];
+
+	int fd = -1;
+	int used = 0;
+	size_t pending = 0;
+
+	flushstdio();
+
+	for (size_t i = 0; i < count; i++)
 	{
-		out << line << std::endl;
+		const logtype& type = *lines[i].type;
+		const int linefd = type.usestderr ? 2 : 1;
+
+		// lines keep their order across stdout and stderr
+		if (pending > 0 && (linefd != fd || pending == maxlines))
+		{
+			writeall(fd, iov, used);
+			used = 0;
+			pending = 0;
+		}
+
+		fd = linefd;
+		used += line_iovecs(iov + used, type, lines[i].line, lines[i].length, usecolor(type));
+		pending++;
 	}
+
+	if (pending > 0)
+		writeall(fd, iov, used);
+#else
+	logdevice::writeloglines(lines, count);
 #endif
 }
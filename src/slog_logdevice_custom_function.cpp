@@ -28,14 +28,38 @@
 
 using namespace slog;
 
-logdevice_custom_function::logdevice_custom_function(const std::string& pfname, cpf pf) : logdevice(pfname), _pf(pf)
+logdevice_custom_function::logdevice_custom_function(const std::string& pfname, cpf pf) : logdevice(pfname, false), _pf(pf)
 {
+	attach();
+}
 
+logdevice_custom_function::logdevice_custom_function(const std::string& pfname, batches, batchpf pf) : logdevice(pfname, false), _batchpf(pf)
+{
+	attach();
+}
+
+logdevice_custom_function::~logdevice_custom_function()
+{
+	detach();
+}
+
+//virtual 
+void logdevice_custom_function::writelogline(const slog::logtype& type, const char* line, size_t length)
+{
+	if (_batchpf)
+	{
+		logline one = { &type, line, length, logconfig::now() };
+		_batchpf(&one, 1);
+	}
+	else if (_pf)
+		_pf(type, std::string(line, length));
 }
 
 //virtual 
-void logdevice_custom_function::writelogline(const slog::logtype& type, const std::string& line)
+void logdevice_custom_function::writeloglines(const logline* lines, size_t count)
 {
-	if (_pf)
-		_pf(type, line);
+	if (_batchpf)
+		_batchpf(lines, count);
+	else
+		logdevice::writeloglines(lines, count);
 }
\ No newline at end of file
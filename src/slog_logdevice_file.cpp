@@ -24,19 +24,372 @@
 //
 //================================================================================
 
+
 #include "slog/slog_logdevice_file.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#ifdef SLOG_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 using namespace slog;
 
-logdevice_file::logdevice_file(const std::string& filename, bool bAppend) : logdevice("logdevice_file")
+const std::chrono::seconds logdevice_file::rotationretry(10);
+
+static std::string segment_name(const std::string& filename, uint32_t segment)
+{
+	return strobj() << filename << "." << segment;
+}
+
+// every filename.N and filename.N.gz on disk, ordered by N. retention deletes the lowest numbers so the
+// segments a previous run left behind need not start at 1 or be contiguous
+static std::vector<std::pair<uint32_t, std::string>> find_segments(const std::string& filename)
+{
+	const size_t slash = filename.find_last_of("/\\");
+	const std::string directory = (slash == std::string::npos) ? std::string() : filename.substr(0, slash + 1);
+	const std::string prefix = filename.substr(directory.size()) + ".";
+
+	std::vector<std::pair<uint32_t, std::string>> found;
+
+	auto consider = [&](const char* entry)
+	{
+		if (strncmp(entry, prefix.c_str(), prefix.size()) != 0)
+			return;
+
+		// only the names rotate_locked produces, no sign, no leading zeros
+		const char* digits = entry + prefix.size();
+		if (*digits < '1' || *digits > '9')
+			return;
+
+		char* end = nullptr;
+		const unsigned long long n = strtoull(digits, &end, 10);
+		if (n > UINT32_MAX || (*end != 0 && strcmp(end, ".gz") != 0))
+			return;
+
+		found.push_back(std::make_pair((uint32_t)n, directory + entry));
+	};
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + prefix + "*").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+			consider(data.cFileName);
+		while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	DIR* dir = opendir(directory.empty() ? "." : directory.c_str());
+	if (dir != nullptr)
+	{
+		while (const dirent* entry = readdir(dir))
+			consider(entry->d_name);
+		closedir(dir);
+	}
+#endif
+
+	std::sort(found.begin(), found.end());
+	return found;
+}
+
+// writes segment.gz and removes segment, false leaves segment untouched
+static bool compress_segment(const std::string& segment)
+{
+#ifdef SLOG_HAVE_ZLIB
+	const std::string compressed = segment + ".gz";
+
+	std::ifstream in(segment.c_str(), std::ios::in | std::ios::binary);
+	if (in.good() == false)
+		return false;
+
+	gzFile out = gzopen(compressed.c_str(), "wb1");
+	if (out == nullptr)
+		return false;
+
+	bool ok = true;
+	std::unique_ptr<char[]> buffer(new char[64 * 1024]);
+	while (ok && in)
+	{
+		in.read(buffer.get(), 64 * 1024);
+		const int length = (int)in.gcount();
+		if (length > 0 && gzwrite(out, buffer.get(), (unsigned)length) != length)
+			ok = false;
+	}
+
+	if (gzclose(out) != Z_OK)
+		ok = false;
+
+	in.close();
+
+	if (ok == false)
+	{
+		std::remove(compressed.c_str());
+		return false;
+	}
+
+	std::remove(segment.c_str());
+	return true;
+#else
+	return false;
+#endif
+}
+
+logdevice_file::logdevice_file(const std::string& filename, bool bAppend, const fileflushpolicy& policy, const filerotationpolicy& rotation) :
+	logdevice("logdevice_file", false), m_filename(filename), m_filesize(0), m_policy(policy), m_stop(false), m_rotation(rotation), m_nextsegment(1), m_rotatestop(false)
 {
+	// we do our own buffering, the stream would only add a copy
+	m_file.rdbuf()->pubsetbuf(nullptr, 0);
+
+	if (bAppend)
+	{
+		std::ifstream existing(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+		if (existing.good())
+			m_filesize = (uint64_t)existing.tellg();
+	}
+
 	auto mode = (bAppend) ? (std::ios::out | std::ios::app) : std::ios::out;
 	m_file.open(filename.c_str(), mode);
 	if (m_file.good() == false)
 		throw std::runtime_error(strobj() << "failed to open log file '" << filename << "' for write");
+
+	if (m_rotation.maxsize > 0 || m_rotation.interval.count() > 0)
+	{
+		// continue numbering after the highest segment a previous run left behind, and have retention
+		// count the old segments in with the new ones
+		for (auto& each : find_segments(filename))
+		{
+			m_segments.push_back(each.second);
+			m_nextsegment = each.first + 1;
+		}
+
+		if (m_rotation.interval.count() > 0)
+		{
+			const auto interval = m_rotation.interval.count();
+			const auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			m_nextrotation = std::chrono::system_clock::time_point(std::chrono::seconds((now / interval + 1) * interval));
+		}
+
+		m_rotatethread = std::thread(&logdevice_file::run_rotation, this);
+	}
+
+	if (m_policy.interval.count() > 0)
+		m_timerthread = std::thread(&logdevice_file::run_timer, this);
+
+	attach();
+}
+
+logdevice_file::~logdevice_file()
+{
+	detach();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_timer.notify_one();
+
+	if (m_timerthread.joinable())
+		m_timerthread.join();
+
+	flush();
+
+	// let the rotation thread finish with whatever segments are still queued
+	{
+		std::lock_guard<std::mutex> lock(m_rotatemutex);
+		m_rotatestop = true;
+	}
+	m_rotatewake.notify_one();
+
+	if (m_rotatethread.joinable())
+		m_rotatethread.join();
+}
+
+void logdevice_file::writelogline(const logtype& type, const char* line, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (rotation_due_locked(length + 1))
+		rotate_locked();
+
+	m_buffer.append(line, length);
+	m_buffer.append('\n');
+
+	if (m_buffer.size() >= m_policy.maxbuffered || type.priority >= m_policy.flushpriority)
+		flush_locked();
+}
+
+void logdevice_file::writeloglines(const logline* lines, size_t count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	bool flushnow = false;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (rotation_due_locked(lines[i].length + 1))
+			rotate_locked();
+
+		m_buffer.append(lines[i].line, lines[i].length);
+		m_buffer.append('\n');
+
+		if (lines[i].type->priority >= m_policy.flushpriority)
+			flushnow = true;
+	}
+
+	if (flushnow || m_buffer.size() >= m_policy.maxbuffered)
+		flush_locked();
+}
+
+void logdevice_file::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	flush_locked();
+}
+
+void logdevice_file::flush_locked()
+{
+	if (m_buffer.size() == 0)
+		return;
+
+	std::lock_guard<std::mutex> writing(m_writemutex);
+	write_locked(m_buffer);
+	m_filesize += m_buffer.size();
+	m_buffer.clear();
+}
+
+// called under m_writemutex
+void logdevice_file::write_locked(const linebuffer& buffer)
+{
+	m_file.write(buffer.data(), buffer.size());
+	m_file.flush();
+}
+
+// the buffer is swapped out under m_mutex and written after it is released, so loggers keep appending while
+// the disk is busy. m_writemutex is taken before m_mutex is released, whatever a logger flushes next lands after
+void logdevice_file::run_timer()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_stop == false)
+	{
+		m_timer.wait_for(lock, m_policy.interval);
+		if (m_buffer.size() == 0)
+			continue;
+
+		std::unique_lock<std::mutex> writing(m_writemutex);
+		m_writing.swap(m_buffer);
+		m_filesize += m_writing.size();
+		lock.unlock();
+
+		write_locked(m_writing);
+		m_writing.clear();
+		writing.unlock();
+
+		lock.lock();
+	}
+}
+
+// checked before a line of the given length is added, a segment never starts empty
+bool logdevice_file::rotation_due_locked(size_t length)
+{
+	const uint64_t current = m_filesize + m_buffer.size();
+	bool due = false;
+
+	if (m_rotation.maxsize > 0 && current > 0 && current + length > m_rotation.maxsize)
+		due = (m_retryrotation == std::chrono::steady_clock::time_point() || std::chrono::steady_clock::now() >= m_retryrotation);
+
+	if (m_rotation.interval.count() > 0)
+	{
+		const auto now = std::chrono::system_clock::now();
+		if (now >= m_nextrotation)
+		{
+			while (m_nextrotation <= now)
+				m_nextrotation += m_rotation.interval;
+
+			if (current > 0)
+				due = true;
+		}
+	}
+
+	return due;
 }
 
-void logdevice_file::writelogline(const logtype& type, const std::string& line)
+void logdevice_file::rotate_locked()
 {
-	m_file << line << std::endl;
-}
\ No newline at end of file
+	flush_locked();
+
+	std::lock_guard<std::mutex> writing(m_writemutex);
+	m_file.close();
+
+	const std::string segment = segment_name(m_filename, m_nextsegment);
+	const bool renamed = (std::rename(m_filename.c_str(), segment.c_str()) == 0);
+
+	m_file.clear();
+	m_file.open(m_filename.c_str(), renamed ? std::ios::out : (std::ios::out | std::ios::app));
+	if (m_file.good() == false)
+		throw std::runtime_error(strobj() << "failed to reopen log file '" << m_filename << "' after rotating it");
+
+	// the file keeps growing until the next attempt, retrying on every line would reopen it on every line
+	if (renamed == false)
+	{
+		if (m_retryrotation == std::chrono::steady_clock::time_point())
+			std::cerr << "logdevice_file could not rotate '" << m_filename << "' to '" << segment << "', retrying every " << rotationretry.count() << "s" << std::endl;
+
+		m_retryrotation = std::chrono::steady_clock::now() + rotationretry;
+		return;
+	}
+
+	m_retryrotation = std::chrono::steady_clock::time_point();
+	m_nextsegment++;
+	m_filesize = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_rotatemutex);
+		m_rotated.push_back(segment);
+	}
+	m_rotatewake.notify_one();
+}
+
+void logdevice_file::run_rotation()
+{
+	std::unique_lock<std::mutex> lock(m_rotatemutex);
+
+	for (;;)
+	{
+		while (m_rotated.empty() && m_rotatestop == false)
+			m_rotatewake.wait(lock);
+
+		if (m_rotated.empty())
+			return;
+
+		std::string segment = std::move(m_rotated.front());
+		m_rotated.pop_front();
+
+		lock.unlock();
+
+		if (m_rotation.compress && compress_segment(segment))
+			segment += ".gz";
+
+		m_segments.push_back(segment);
+
+		while (m_rotation.keep > 0 && m_segments.size() > m_rotation.keep)
+		{
+			std::remove(m_segments.front().c_str());
+			m_segments.pop_front();
+		}
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,316 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#include "slog/slog_logdevice_flightrecorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+using namespace slog;
+
+// set while the thread is dumping, an error it logs from within the dump does not start another one
+static thread_local bool _dumping = false;
+
+logdevice_flightrecorder::logdevice_flightrecorder(const std::string& filename, size_t capacity, uint32_t dumppriority) :
+	m_mask(0), m_head(0), m_dumppriority(dumppriority), m_dumped(0), m_file(nullptr)
+{
+	m_file = std::fopen(filename.c_str(), "ab");
+	if (m_file == nullptr)
+		throw std::runtime_error(strobj() << "failed to open flight recorder file '" << filename << "' for write");
+
+	start(capacity);
+}
+
+logdevice_flightrecorder::logdevice_flightrecorder(dumpfunction dump, size_t capacity, uint32_t dumppriority) :
+	m_mask(0), m_head(0), m_dumppriority(dumppriority), m_dumped(0), m_file(nullptr), m_dumpfunction(std::move(dump))
+{
+	start(capacity);
+}
+
+void logdevice_flightrecorder::start(size_t capacity)
+{
+	size_t slots = 1;
+	while (slots < capacity)
+		slots <<= 1;
+
+	m_slots.reset(new slot[slots]);
+	m_mask = slots - 1;
+
+	for (size_t i = 0; i < slots; i++)
+		m_slots[i].seq.store(0, std::memory_order_relaxed);
+
+	// the ring is filled in before the recorder is published, record may run as soon as it is
+	logdevice_flightrecorder* none = nullptr;
+	if (logconfig::_recorder.compare_exchange_strong(none, this) == false)
+	{
+		if (m_file)
+			std::fclose(m_file);
+		throw std::runtime_error("a flight recorder is already recording, only one can be alive at a time");
+	}
+}
+
+#ifndef _WIN32
+static std::atomic<logdevice_flightrecorder*> _signal_recorder(nullptr);
+static std::atomic<int> _signal_fd(2);
+static const int _fatal_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+static struct sigaction _previous_actions[sizeof(_fatal_signals) / sizeof(_fatal_signals[0])];
+
+static void restore_signal_handlers()
+{
+	for (size_t i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+		sigaction(_fatal_signals[i], &_previous_actions[i], nullptr);
+}
+#endif
+
+logdevice_flightrecorder::~logdevice_flightrecorder()
+{
+#ifndef _WIN32
+	logdevice_flightrecorder* self = this;
+	if (_signal_recorder.compare_exchange_strong(self, nullptr))
+		restore_signal_handlers();
+#endif
+
+	logconfig::_recorder.store(nullptr);
+
+	// a thread that loaded the recorder before the store did so under a deviceregistry::reader
+	deviceregistry::synchronize();
+
+	if (m_file)
+		std::fclose(m_file);
+}
+
+//static
+void logdevice_flightrecorder::recordcurrent(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength)
+{
+	logdevice_flightrecorder* recorder = logconfig::_recorder.load();
+	if (recorder)
+		recorder->record(ltype, msg, length, fields, fieldslength);
+}
+
+void logdevice_flightrecorder::record(const logtype& ltype, const char* msg, size_t length, const char* fields, size_t fieldslength)
+{
+	const uint64_t position = m_head.fetch_add(1, std::memory_order_relaxed);
+	slot& s = m_slots[position & m_mask];
+
+	// a writer that lapped the ring may still be in the slot, or may already have put a newer record there.
+	// either way this record is lost rather than waiting
+	uint64_t current = s.seq.load(std::memory_order_relaxed);
+	if ((current & 1) != 0 || current > position * 2 ||
+		s.seq.compare_exchange_strong(current, position * 2 + 1, std::memory_order_relaxed) == false)
+		return;
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (length > slotbytes)
+		length = slotbytes;
+	if (fieldslength > slotbytes - length)
+		fieldslength = 0;
+
+	const size_t used = headerwords + (length + fieldslength + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	uint64_t words[slotwords];
+	words[0] = (uint64_t)(uintptr_t)&ltype;
+	words[1] = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(logconfig::now().time_since_epoch()).count();
+	words[2] = (uint64_t)length | ((uint64_t)fieldslength << 32);
+	words[used - 1] = 0;
+	std::memcpy(&words[headerwords], msg, length);
+	if (fieldslength)
+		std::memcpy((char*)&words[headerwords] + length, fields, fieldslength);
+
+	for (size_t i = 0; i < used; i++)
+		s.words[i].store(words[i], std::memory_order_relaxed);
+
+	s.seq.store(position * 2 + 2, std::memory_order_release);
+
+	if (ltype.priority >= m_dumppriority && _dumping == false)
+		dump();
+}
+
+// false when the record at position is being written, was overwritten or was never completed
+bool logdevice_flightrecorder::read(uint64_t position, copied& out) const
+{
+	const slot& s = m_slots[position & m_mask];
+	const uint64_t expected = position * 2 + 2;
+
+	if (s.seq.load(std::memory_order_acquire) != expected)
+		return false;
+
+	const uint64_t lengths = s.words[2].load(std::memory_order_relaxed);
+	out.type = (const logtype*)(uintptr_t)s.words[0].load(std::memory_order_relaxed);
+	out.ns = (int64_t)s.words[1].load(std::memory_order_relaxed);
+	out.length = (uint32_t)lengths;
+	out.fieldslength = (uint32_t)(lengths >> 32);
+
+	if ((uint64_t)out.length + out.fieldslength > slotbytes)
+		return false;
+
+	const size_t used = (out.length + out.fieldslength + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	for (size_t i = 0; i < used; i++)
+		out.data[i] = s.words[headerwords + i].load(std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return s.seq.load(std::memory_order_relaxed) == expected;
+}
+
+void logdevice_flightrecorder::dump()
+{
+	std::lock_guard<std::mutex> lock(m_dumpmutex);
+
+	struct dumping
+	{
+		dumping() { _dumping = true; }
+		~dumping() { _dumping = false; }
+	} guard;
+
+	const uint64_t head = m_head.load(std::memory_order_acquire);
+	const uint64_t capacity = m_mask + 1;
+
+	copied record;
+	for (uint64_t position = std::max(m_dumped, head > capacity ? head - capacity : 0); position < head; position++)
+	{
+		if (read(position, record))
+			writeout(record);
+	}
+
+	m_dumped = head;
+
+	if (m_file)
+		std::fflush(m_file);
+}
+
+void logdevice_flightrecorder::writeout(const copied& record)
+{
+	const char* message = (const char*)record.data;
+	const auto when = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(record.ns)));
+
+	logconfig::formatmsg(*record.type, message, record.length, message + record.length, record.fieldslength, m_line, when, loglayout::text);
+
+	if (m_file)
+	{
+		m_line.append('\n');
+		std::fwrite(m_line.data(), 1, m_line.size(), m_file);
+	}
+	else if (m_dumpfunction)
+		m_dumpfunction(*record.type, std::string(m_line.data(), m_line.size()));
+}
+
+#ifndef _WIN32
+void logdevice_flightrecorder::dumponfatalsignal()
+{
+	// there is only one recorder, so the handlers are either this one's or not installed yet
+	_signal_fd.store(m_file ? fileno(m_file) : 2);
+
+	logdevice_flightrecorder* none = nullptr;
+	if (_signal_recorder.compare_exchange_strong(none, this) == false)
+		return;
+
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = &logdevice_flightrecorder::on_fatal_signal;
+	sigemptyset(&action.sa_mask);
+
+	for (size_t i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+		sigaction(_fatal_signals[i], &action, &_previous_actions[i]);
+}
+
+//static
+void logdevice_flightrecorder::on_fatal_signal(int signal)
+{
+	logdevice_flightrecorder* recorder = _signal_recorder.exchange(nullptr);
+	if (recorder)
+		recorder->dump_unformatted(_signal_fd.load());
+
+	// the previous handler, or the default action, gets the signal as soon as this one returns
+	restore_signal_handlers();
+	raise(signal);
+}
+
+static char* put_decimal(char* dest, uint64_t value, int width)
+{
+	char digits[20];
+	int count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+
+	while (count < width)
+		digits[count++] = '0';
+
+	while (count > 0)
+		*dest++ = digits[--count];
+	return dest;
+}
+
+// nothing here allocates, locks or formats through the c library
+void logdevice_flightrecorder::dump_unformatted(int fd)
+{
+	const uint64_t head = m_head.load(std::memory_order_acquire);
+	const uint64_t capacity = m_mask + 1;
+
+	copied record;
+	char line[slotbytes + 128];
+
+	for (uint64_t position = std::max(m_dumped, head > capacity ? head - capacity : 0); position < head; position++)
+	{
+		if (read(position, record) == false)
+			continue;
+
+		const uint64_t us = (uint64_t)record.ns / 1000;
+		const size_t namelength = std::min<size_t>(record.type->name.size(), 64);
+
+		char* pos = line;
+		*pos++ = '[';
+		pos = put_decimal(pos, us / 1000000, 1);
+		*pos++ = '.';
+		pos = put_decimal(pos, us % 1000000, 6);
+		std::memcpy(pos, "] - [", 5);
+		pos += 5;
+		std::memcpy(pos, record.type->name.data(), namelength);
+		pos += namelength;
+		std::memcpy(pos, "] - ", 4);
+		pos += 4;
+		std::memcpy(pos, record.data, record.length);
+		pos += record.length;
+		*pos++ = '\n';
+
+		for (const char* from = line; from < pos; )
+		{
+			const ssize_t written = ::write(fd, from, pos - from);
+			if (written <= 0)
+				return;
+			from += written;
+		}
+	}
+}
+#endif
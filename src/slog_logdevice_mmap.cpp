@@ -0,0 +1,121 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_logdevice_mmap.h"
+
+#ifndef _WIN32
+
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace slog;
+
+logdevice_mmap::logdevice_mmap(const std::string& filename, bool bAppend, size_t chunksize) : logdevice("logdevice_mmap", false),
+	m_filename(filename), m_fd(-1), m_map(nullptr), m_capacity(0), m_size(0)
+{
+	// the mapping is always a whole number of pages
+	const size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+	m_chunksize = ((chunksize + pagesize - 1) / pagesize) * pagesize;
+	if (m_chunksize == 0)
+		m_chunksize = pagesize;
+
+	m_fd = open(filename.c_str(), O_RDWR | O_CREAT | (bAppend ? 0 : O_TRUNC), 0644);
+	if (m_fd < 0)
+		throw std::runtime_error(strobj() << "failed to open log file '" << filename << "' for write: " << strerror(errno));
+
+	struct stat st;
+	if (bAppend && fstat(m_fd, &st) == 0)
+		m_size = (size_t)st.st_size;
+
+	try
+	{
+		grow_locked(m_size + 1);
+	}
+	catch (...)
+	{
+		close(m_fd);
+		throw;
+	}
+
+	attach();
+}
+
+logdevice_mmap::~logdevice_mmap()
+{
+	detach();
+
+	if (m_map)
+		munmap(m_map, m_capacity);
+
+	// drop the preallocated tail
+	if (ftruncate(m_fd, (off_t)m_size) != 0)
+		std::cerr << "logdevice_mmap failed to truncate '" << m_filename << "': " << strerror(errno) << std::endl;
+
+	close(m_fd);
+}
+
+void logdevice_mmap::grow_locked(size_t minsize)
+{
+	size_t capacity = m_capacity;
+	while (capacity < minsize)
+		capacity += m_chunksize;
+
+	if (ftruncate(m_fd, (off_t)capacity) != 0)
+		throw std::runtime_error(strobj() << "failed to extend log file '" << m_filename << "': " << strerror(errno));
+
+	if (m_map)
+		munmap(m_map, m_capacity);
+
+	void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED)
+	{
+		m_map = nullptr;
+		m_capacity = 0;
+		throw std::runtime_error(strobj() << "failed to map log file '" << m_filename << "': " << strerror(errno));
+	}
+
+	m_map = (char*)map;
+	m_capacity = capacity;
+}
+
+void logdevice_mmap::writelogline(const logtype& type, const char* line, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_size + length + 1 > m_capacity)
+		grow_locked(m_size + length + 1);
+
+	std::memcpy(m_map + m_size, line, length);
+	m_map[m_size + length] = '\n';
+	m_size += length + 1;
+}
+
+#endif
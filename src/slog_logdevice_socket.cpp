@@ -0,0 +1,422 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+
+#include "slog/slog_logdevice_socket.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define SLOG_SEND_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL)
+#else
+#define SLOG_SEND_FLAGS MSG_DONTWAIT
+#endif
+
+using namespace slog;
+
+// records handed to the kernel in one call
+static const size_t sendbatch = 64;
+
+// how long the retry thread waits for the socket to become writable before it looks at its state again,
+// and how long it backs off after an attempt that sent nothing
+static const int retrypoll = 50;
+static const std::chrono::milliseconds retrydelay(10);
+
+static uint32_t syslog_severity(uint32_t priority)
+{
+	if (priority >= logtype_error::Priority)
+		return 3;	// err
+	if (priority >= logtype_warn::Priority)
+		return 4;	// warning
+	if (priority >= logtype_info::Priority)
+		return 6;	// info
+	return 7;		// debug
+}
+
+static std::string rfc3339(std::chrono::system_clock::time_point when)
+{
+	const int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(when.time_since_epoch()).count();
+	const time_t second = (time_t)(micros / 1000000);
+
+	tm tmstr;
+	gmtime_r(&second, &tmstr);
+
+	char text[40];
+	const int length = std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ", 1900 + tmstr.tm_year, tmstr.tm_mon + 1, tmstr.tm_mday,
+		tmstr.tm_hour, tmstr.tm_min, tmstr.tm_sec, (int)(micros % 1000000));
+
+	return std::string(text, length > 0 ? (size_t)length : 0);
+}
+
+logdevice_socket::logdevice_socket(const std::string& path, const socketpolicy& policy) :
+	logdevice("logdevice_socket", false), m_path(path), m_policy(policy), m_fd(-1), m_pendingbytes(0), m_stop(false)
+{
+	if (path.empty() || path.size() >= sizeof(sockaddr_un().sun_path))
+		throw std::runtime_error(strobj() << "'" << path << "' can not be used as a socket path");
+
+	char hostname[256] = "-";
+	if (gethostname(hostname, sizeof(hostname)) != 0 || hostname[0] == 0)
+		std::strcpy(hostname, "-");
+	hostname[sizeof(hostname) - 1] = 0;
+
+	m_header = strobj() << " " << hostname << " " << (policy.appname.empty() ? "-" : policy.appname) << " " << getpid() << " - - ";
+
+	// the collector not being there yet is no reason to fail, it is tried again on the next write
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		connect_locked();
+	}
+
+	m_retrythread = std::thread(&logdevice_socket::run_retry, this);
+
+	attach();
+}
+
+logdevice_socket::~logdevice_socket()
+{
+	detach();
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_retry.notify_one();
+
+	if (m_retrythread.joinable())
+		m_retrythread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (size_t i = 0; i < m_pending.size(); i++)
+		logstats::countdropped();
+
+	disconnect_locked();
+}
+
+bool logdevice_socket::connected() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fd >= 0;
+}
+
+bool logdevice_socket::flush(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_pending.empty())
+		return true;
+
+	// a flush does not wait out the reconnect interval
+	if (m_fd < 0)
+		m_nextattempt = std::chrono::steady_clock::time_point();
+	m_retry.notify_one();
+
+	return m_drained.wait_for(lock, timeout, [this] { return m_pending.empty(); });
+}
+
+void logdevice_socket::writelogline(const logtype& type, const char* line, size_t length)
+{
+	const logline one = { &type, line, length, logconfig::now() };
+	writeloglines(&one, 1);
+}
+
+void logdevice_socket::writeloglines(const logline* lines, size_t count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (size_t i = 0; i < count; i++)
+		frame(lines[i]);
+
+	send_locked();
+
+	if (m_policy.buffer)
+		trim_locked();
+	else
+	{
+		// only the rest of a record that is partly sent stays, the stream would be corrupt without it
+		while (m_pending.empty() == false && m_pending.back().start == 0)
+		{
+			m_pendingbytes -= m_pending.back().bytes.size();
+			m_pending.pop_back();
+			logstats::countdropped();
+		}
+	}
+
+	if (m_pending.empty())
+		m_drained.notify_all();
+	else
+		m_retry.notify_one();
+}
+
+void logdevice_socket::frame(const logline& line)
+{
+	record r;
+	r.start = 0;
+
+	if (m_policy.framing == socketframing::rfc5424)
+	{
+		const uint32_t pri = m_policy.facility * 8 + syslog_severity(line.type->priority);
+		const std::string message = strobj() << "<" << pri << ">1 " << rfc3339(line.when) << m_header;
+
+		// octet counting, RFC 6587 3.4.1
+		if (m_policy.stream)
+			r.bytes = strobj() << message.size() + line.length << " ";
+
+		r.bytes += message;
+		r.bytes.append(line.line, line.length);
+	}
+	else
+	{
+		r.bytes.assign(line.line, line.length);
+		if (m_policy.stream)
+			r.bytes += '\n';
+	}
+
+	m_pendingbytes += r.bytes.size();
+	m_pending.push_back(std::move(r));
+}
+
+bool logdevice_socket::connect_locked()
+{
+	m_nextattempt = std::chrono::steady_clock::now() + m_policy.reconnect;
+
+	const int fd = socket(AF_UNIX, m_policy.stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+	if (fd < 0)
+		return false;
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+#ifdef SO_NOSIGPIPE
+	const int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, m_path.c_str(), m_path.size());
+
+	// a unix socket connects right away or not at all, a full backlog counts as not at all
+	if (connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	m_fd = fd;
+	return true;
+}
+
+void logdevice_socket::disconnect_locked()
+{
+	if (m_fd < 0)
+		return;
+
+	close(m_fd);
+	m_fd = -1;
+
+	// the rest of a partly sent record means nothing to the next connection
+	if (m_pending.empty() == false && m_pending.front().start > 0)
+	{
+		m_pendingbytes -= m_pending.front().bytes.size();
+		m_pending.pop_front();
+		logstats::countdropped();
+	}
+}
+
+// sends as much as the socket takes without blocking
+void logdevice_socket::send_locked()
+{
+	if (m_fd < 0 && (std::chrono::steady_clock::now() < m_nextattempt || connect_locked() == false))
+		return;
+
+	while (m_pending.empty() == false)
+	{
+		const size_t batch = std::min(m_pending.size(), sendbatch);
+
+		iovec iov[sendbatch];
+		for (size_t i = 0; i < batch; i++)
+		{
+			const record& r = m_pending[i];
+			iov[i].iov_base = (void*)(r.bytes.data() + r.start);
+			iov[i].iov_len = r.bytes.size() - r.start;
+		}
+
+		size_t sentrecords = 0;
+		size_t sentbytes = 0;
+		int error = 0;
+
+		if (m_policy.stream)
+		{
+			msghdr msg;
+			std::memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = batch;
+
+			const ssize_t sent = sendmsg(m_fd, &msg, SLOG_SEND_FLAGS);
+			if (sent < 0)
+				error = errno;
+			else
+				sentbytes = (size_t)sent;
+		}
+		else
+		{
+#ifdef __linux__
+			mmsghdr msgs[sendbatch];
+			std::memset(msgs, 0, sizeof(mmsghdr) * batch);
+			for (size_t i = 0; i < batch; i++)
+			{
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			const int sent = sendmmsg(m_fd, msgs, (unsigned)batch, SLOG_SEND_FLAGS);
+			if (sent < 0)
+				error = errno;
+			else
+				sentrecords = (size_t)sent;
+#else
+			for (; sentrecords < batch; sentrecords++)
+			{
+				if (send(m_fd, iov[sentrecords].iov_base, iov[sentrecords].iov_len, SLOG_SEND_FLAGS) < 0)
+				{
+					error = errno;
+					break;
+				}
+			}
+#endif
+		}
+
+		// whole records from the front, on stream sockets the last one may be partly sent
+		for (; sentrecords > 0; sentrecords--)
+		{
+			m_pendingbytes -= m_pending.front().bytes.size();
+			m_pending.pop_front();
+		}
+
+		while (sentbytes > 0)
+		{
+			record& r = m_pending.front();
+			const size_t left = r.bytes.size() - r.start;
+			if (sentbytes < left)
+			{
+				r.start += sentbytes;
+				break;
+			}
+
+			sentbytes -= left;
+			m_pendingbytes -= r.bytes.size();
+			m_pending.pop_front();
+		}
+
+		if (error == 0 || error == EINTR)
+			continue;
+
+		// the collector is busy, what it did not take waits for the retry thread
+		if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS)
+			return;
+
+		// a datagram that can never be sent
+		if (error == EMSGSIZE && m_policy.stream == false)
+		{
+			m_pendingbytes -= m_pending.front().bytes.size();
+			m_pending.pop_front();
+			logstats::countdropped();
+			continue;
+		}
+
+		// the collector went away, it gets one immediate retry
+		disconnect_locked();
+		m_nextattempt = std::chrono::steady_clock::time_point();
+		return;
+	}
+}
+
+// drops the oldest whole records until the buffer fits
+void logdevice_socket::trim_locked()
+{
+	const size_t keep = (m_pending.empty() == false && m_pending.front().start > 0) ? 1 : 0;
+
+	while (m_pendingbytes > m_policy.maxbuffered && m_pending.size() > keep)
+	{
+		m_pendingbytes -= m_pending[keep].bytes.size();
+		m_pending.erase(m_pending.begin() + keep);
+		logstats::countdropped();
+	}
+}
+
+// sends what the collector could not take when it was written, independently of new writes
+void logdevice_socket::run_retry()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_stop == false)
+	{
+		if (m_pending.empty())
+		{
+			m_retry.wait(lock);
+			continue;
+		}
+
+		// a closed or reused descriptor only makes the poll return early, the state is checked again under the lock
+		if (m_fd >= 0)
+		{
+			pollfd writable = { m_fd, POLLOUT, 0 };
+			lock.unlock();
+			poll(&writable, 1, retrypoll);
+			lock.lock();
+		}
+		else if (std::chrono::steady_clock::now() < m_nextattempt)
+			m_retry.wait_until(lock, m_nextattempt);
+
+		if (m_stop || m_pending.empty())
+			continue;
+
+		const size_t records = m_pending.size();
+		const size_t start = m_pending.front().start;
+		send_locked();
+
+		if (m_pending.empty())
+			m_drained.notify_all();
+		else if (m_pending.size() == records && m_pending.front().start == start)
+			m_retry.wait_for(lock, retrydelay);
+	}
+}
+
+#endif
@@ -0,0 +1,178 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_lz.h"
+
+#include <cstring>
+#include <vector>
+
+namespace slog
+{
+namespace lz
+{
+	static const size_t minmatch = 4;
+	static const size_t maxoffset = 65535;
+	static const uint32_t hashbits = 12;
+
+	static inline uint32_t read32(const char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static inline uint32_t hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - hashbits);
+	}
+
+	static void putlength(std::string& out, size_t length)
+	{
+		while (length >= 255)
+		{
+			out.push_back((char)255);
+			length -= 255;
+		}
+		out.push_back((char)length);
+	}
+
+	static void putsequence(std::string& out, const char* literals, size_t literalcount, size_t offset, size_t matchlength)
+	{
+		const size_t matchcode = matchlength ? matchlength - minmatch : 0;
+
+		out.push_back((char)(((literalcount < 15 ? literalcount : 15) << 4) | (matchcode < 15 ? matchcode : 15)));
+		if (literalcount >= 15)
+			putlength(out, literalcount - 15);
+
+		out.append(literals, literalcount);
+
+		if (matchlength == 0)
+			return;
+
+		out.push_back((char)(offset & 0xff));
+		out.push_back((char)(offset >> 8));
+		if (matchcode >= 15)
+			putlength(out, matchcode - 15);
+	}
+
+	void compress(const char* input, size_t length, std::string& out)
+	{
+		// positions are stored + 1 so that 0 means empty
+		std::vector<uint32_t> table(1 << hashbits, 0);
+
+		size_t pos = 0;
+		size_t anchor = 0;
+
+		while (pos + minmatch <= length)
+		{
+			const uint32_t sequence = read32(input + pos);
+			const uint32_t h = hash(sequence);
+			const uint32_t candidate = table[h];
+			table[h] = (uint32_t)pos + 1;
+
+			if (candidate == 0 || pos - (candidate - 1) > maxoffset || read32(input + candidate - 1) != sequence)
+			{
+				pos++;
+				continue;
+			}
+
+			const size_t match = candidate - 1;
+			size_t matchlength = minmatch;
+			while (pos + matchlength < length && input[match + matchlength] == input[pos + matchlength])
+				matchlength++;
+
+			putsequence(out, input + anchor, pos - anchor, pos - match, matchlength);
+
+			pos += matchlength;
+			anchor = pos;
+		}
+
+		putsequence(out, input + anchor, length - anchor, 0, 0);
+	}
+
+	static bool getlength(const unsigned char*& in, const unsigned char* end, size_t& length)
+	{
+		unsigned char more;
+		do
+		{
+			if (in >= end)
+				return false;
+			more = *in++;
+			length += more;
+		} while (more == 255);
+		return true;
+	}
+
+	bool decompress(const char* input, size_t length, size_t rawlength, std::string& out)
+	{
+		const unsigned char* in = (const unsigned char*)input;
+		const unsigned char* const end = in + length;
+		const size_t start = out.size();
+
+		out.reserve(start + rawlength);
+
+		while (in < end)
+		{
+			const unsigned char token = *in++;
+
+			size_t literalcount = token >> 4;
+			if (literalcount == 15 && getlength(in, end, literalcount) == false)
+				return false;
+
+			if ((size_t)(end - in) < literalcount)
+				return false;
+
+			out.append((const char*)in, literalcount);
+			in += literalcount;
+
+			// the last sequence has no match
+			if (in == end)
+				break;
+
+			if (end - in < 2)
+				return false;
+
+			const size_t offset = in[0] | (in[1] << 8);
+			in += 2;
+
+			size_t matchlength = token & 15;
+			if (matchlength == 15 && getlength(in, end, matchlength) == false)
+				return false;
+			matchlength += minmatch;
+
+			if (offset == 0 || offset > out.size() - start)
+				return false;
+
+			// byte by byte since the match may overlap what it is copying
+			size_t from = out.size() - offset;
+			for (size_t i = 0; i < matchlength; i++)
+				out.push_back(out[from + i]);
+		}
+
+		return out.size() - start == rawlength;
+	}
+}
+}
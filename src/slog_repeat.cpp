@@ -0,0 +1,217 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog_repeat.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace slog;
+
+// set while a thread writes to the devices, a device logging from inside its write already holds a turn and
+// waiting for the next one would deadlock
+static thread_local uint32_t _dispatching = 0;
+
+// FNV-1a, the message is compared in full when the hashes match
+static uint64_t hash_message(const char* message, size_t length, uint64_t hash = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (uint8_t)message[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+repeatfilter::repeatfilter(std::chrono::milliseconds timeout) : _timeout(timeout), _stop(false)
+{
+	_thread = std::thread(&repeatfilter::run, this);
+}
+
+repeatfilter::~repeatfilter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wakeup.notify_one();
+
+	if (_thread.joinable())
+		_thread.join();
+
+	for (auto& each : _states)
+		summarize(*each.first, take_repeats(each.second), _summary);
+}
+
+void repeatfilter::write(const logtype& ltype, const char* message, size_t length, const char* fields, size_t fieldslength, linebuffer& line)
+{
+	const uint64_t hash = hash_message(fields, fieldslength, hash_message(message, length));
+
+	// only the bookkeeping is done under the lock, the devices are written to after it is released so
+	// threads do not queue up behind each other's writes and a device may log itself
+	uint64_t repeats = 0;
+	bool repeated = false;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	state& s = _states[&ltype];
+
+	repeated = (s.hash == hash && s.message.size() == length && s.message.compare(0, length, message, length) == 0 &&
+		s.fields.size() == fieldslength && s.fields.compare(0, fieldslength, fields, fieldslength) == 0);
+
+	if (repeated)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		logstats::countcollapsed();
+
+		if (s.repeats++ == 0)
+			s.firstrepeat = now;
+		else if (now - s.firstrepeat >= _timeout)
+			repeats = take_repeats(s);
+
+		if (repeats == 0)
+			return;
+	}
+	else
+	{
+		repeats = take_repeats(s);
+
+		s.hash = hash;
+		s.message.assign(message, length);
+		s.fields.assign(fields, fieldslength);
+	}
+
+	const bool ordered = _dispatching == 0;
+	if (ordered)
+		wait_turn(lock, s, s.issued++);
+	lock.unlock();
+
+	_dispatching++;
+	try
+	{
+		summarize(ltype, repeats, line);
+
+		if (repeated == false)
+			logconfig::dispatchmessage(ltype, message, length, fields, fieldslength, line);
+	}
+	catch (...)
+	{
+		_dispatching--;
+		if (ordered)
+			end_turn(s);
+		throw;
+	}
+	_dispatching--;
+
+	if (ordered)
+		end_turn(s);
+}
+
+//static
+uint64_t repeatfilter::take_repeats(state& s)
+{
+	const uint64_t repeats = s.repeats;
+	s.repeats = 0;
+	return repeats;
+}
+
+//static
+void repeatfilter::wait_turn(std::unique_lock<std::mutex>& lock, state& s, uint64_t ticket)
+{
+	s.turn.wait(lock, [&s, ticket] { return s.served == ticket; });
+}
+
+void repeatfilter::end_turn(state& s)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		s.served++;
+	}
+	s.turn.notify_all();
+}
+
+//static
+void repeatfilter::summarize(const logtype& ltype, uint64_t repeats, linebuffer& line)
+{
+	if (repeats == 0)
+		return;
+
+	char message[64];
+	const int length = snprintf(message, sizeof(message), "last message repeated %llu %s", (unsigned long long)repeats, repeats == 1 ? "time" : "times");
+
+	logconfig::dispatchmessage(ltype, message, (size_t)length, nullptr, 0, line);
+}
+
+// writes the summaries of repeats that went quiet
+void repeatfilter::run()
+{
+	struct summary
+	{
+		const logtype* type;
+		state* s;
+		uint64_t repeats;
+		uint64_t ticket;
+	};
+
+	std::vector<summary> due;
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (_stop == false)
+	{
+		_wakeup.wait_for(lock, _timeout);
+
+		const auto now = std::chrono::steady_clock::now();
+		for (auto& each : _states)
+		{
+			state& s = each.second;
+			if (s.repeats > 0 && now - s.firstrepeat >= _timeout)
+			{
+				const summary next = { each.first, &s, take_repeats(s), s.issued++ };
+				due.push_back(next);
+			}
+		}
+
+		for (auto& each : due)
+		{
+			wait_turn(lock, *each.s, each.ticket);
+			lock.unlock();
+
+			_dispatching++;
+			try
+			{
+				summarize(*each.type, each.repeats, _summary);
+			}
+			catch (...)
+			{
+				logstats::countexception();
+			}
+			_dispatching--;
+
+			end_turn(*each.s);
+			lock.lock();
+		}
+		due.clear();
+	}
+}
@@ -0,0 +1,342 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+#include "slog/slog.h"
+#include "slog/slog_limit.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+using namespace slog;
+
+std::atomic<uint32_t> logstats::_timing(8);
+
+namespace
+{
+	// only the owning thread writes these, so a count is a plain load and store and never a locked add
+	inline void bump(std::atomic<uint64_t>& counter, uint64_t by = 1)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+	}
+
+	struct typecounters
+	{
+		std::atomic<const logtype*> type;
+		std::atomic<uint64_t> lines;
+		std::atomic<uint64_t> bytes;
+	};
+
+	struct threadcounters
+	{
+		// a thread logging more types than this counts the rest under other
+		static const uint32_t maxtypes = 32;
+
+		threadcounters();
+		~threadcounters();
+
+		typecounters& slot(const logtype& ltype)
+		{
+			const uint32_t used = typecount.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < used; i++)
+			{
+				if (types[i].type.load(std::memory_order_relaxed) == &ltype)
+					return types[i];
+			}
+
+			if (used == maxtypes)
+				return other;
+
+			// published after the type so a snapshot never sees a slot without one
+			types[used].type.store(&ltype, std::memory_order_relaxed);
+			typecount.store(used + 1, std::memory_order_release);
+			return types[used];
+		}
+
+		typecounters types[maxtypes];
+		typecounters other;
+		std::atomic<uint32_t> typecount;
+		std::atomic<uint64_t> dropped;
+		std::atomic<uint64_t> collapsed;
+		std::atomic<uint64_t> filtered;
+		std::atomic<uint64_t> exceptions;
+	};
+
+	// the threads that are counting and what the ones that exited counted. never freed, threads can
+	// still be exiting while static destructors run
+	struct allcounters
+	{
+		allcounters() : dropped(0), collapsed(0), filtered(0), exceptions(0) { }
+
+		std::mutex mutex;
+		std::vector<threadcounters*> threads;
+		std::map<std::string, logstats::typestats> types;
+		uint64_t dropped;
+		uint64_t collapsed;
+		uint64_t filtered;
+		uint64_t exceptions;
+	};
+
+	allcounters& counters()
+	{
+		static allcounters* instance = new allcounters;
+		return *instance;
+	}
+
+	// adds what a thread counted to the totals, called under the mutex
+	void add_thread_locked(const threadcounters& thread, std::map<std::string, logstats::typestats>& types, uint64_t& dropped, uint64_t& collapsed,
+		uint64_t& filtered, uint64_t& exceptions)
+	{
+		const uint32_t used = thread.typecount.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < used; i++)
+		{
+			const logtype* ltype = thread.types[i].type.load(std::memory_order_relaxed);
+			logstats::typestats& total = types[ltype->name];
+			total.lines += thread.types[i].lines.load(std::memory_order_relaxed);
+			total.bytes += thread.types[i].bytes.load(std::memory_order_relaxed);
+		}
+
+		const uint64_t otherlines = thread.other.lines.load(std::memory_order_relaxed);
+		if (otherlines > 0)
+		{
+			logstats::typestats& total = types[logstats::othertypes()];
+			total.lines += otherlines;
+			total.bytes += thread.other.bytes.load(std::memory_order_relaxed);
+		}
+
+		dropped += thread.dropped.load(std::memory_order_relaxed);
+		collapsed += thread.collapsed.load(std::memory_order_relaxed);
+		filtered += thread.filtered.load(std::memory_order_relaxed);
+		exceptions += thread.exceptions.load(std::memory_order_relaxed);
+	}
+
+	threadcounters::threadcounters() : typecount(0), dropped(0), collapsed(0), filtered(0), exceptions(0)
+	{
+		for (auto& each : types)
+		{
+			each.type.store(nullptr, std::memory_order_relaxed);
+			each.lines.store(0, std::memory_order_relaxed);
+			each.bytes.store(0, std::memory_order_relaxed);
+		}
+
+		other.type.store(nullptr, std::memory_order_relaxed);
+		other.lines.store(0, std::memory_order_relaxed);
+		other.bytes.store(0, std::memory_order_relaxed);
+
+		allcounters& all = counters();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		all.threads.push_back(this);
+	}
+
+	threadcounters::~threadcounters()
+	{
+		allcounters& all = counters();
+		std::lock_guard<std::mutex> lock(all.mutex);
+
+		add_thread_locked(*this, all.types, all.dropped, all.collapsed, all.filtered, all.exceptions);
+		all.threads.erase(std::find(all.threads.begin(), all.threads.end(), this));
+	}
+
+	// the counters are reached through a plain pointer, a thread_local with a constructor would be checked
+	// for initialization on every access. the owner frees them when the thread exits
+	thread_local threadcounters* _thread_counters = nullptr;
+
+	struct threadcountersowner
+	{
+		bool armed;
+
+		~threadcountersowner()
+		{
+			delete _thread_counters;
+			_thread_counters = nullptr;
+		}
+	};
+
+	thread_local threadcountersowner _thread_counters_owner;
+
+	threadcounters& mycounters()
+	{
+		if (_thread_counters == nullptr)
+		{
+			_thread_counters_owner.armed = true;	// the first touch registers its destructor for this thread
+			_thread_counters = new threadcounters;
+		}
+		return *_thread_counters;
+	}
+}
+
+//static
+void logstats::countline(const logtype& ltype, size_t bytes)
+{
+	typecounters& slot = mycounters().slot(ltype);
+	bump(slot.lines);
+	bump(slot.bytes, bytes);
+}
+
+//static
+void logstats::countdropped()
+{
+	bump(mycounters().dropped);
+}
+
+//static
+void logstats::countcollapsed()
+{
+	bump(mycounters().collapsed);
+}
+
+//static
+void logstats::countfiltered()
+{
+	bump(mycounters().filtered);
+}
+
+//static
+void logstats::countexception()
+{
+	bump(mycounters().exceptions);
+}
+
+//static
+void logstats::settiming(uint32_t every)
+{
+	_timing.store(every, std::memory_order_relaxed);
+}
+
+//static
+logstats logstats::snapshot()
+{
+	logstats stats;
+
+	{
+		allcounters& all = counters();
+		std::lock_guard<std::mutex> lock(all.mutex);
+
+		std::map<std::string, typestats> types(all.types);
+		stats.dropped = all.dropped;
+		stats.collapsed = all.collapsed;
+		stats.filtered = all.filtered;
+		stats.exceptions = all.exceptions;
+
+		for (auto thread : all.threads)
+			add_thread_locked(*thread, types, stats.dropped, stats.collapsed, stats.filtered, stats.exceptions);
+
+		for (auto& each : types)
+		{
+			each.second.name = each.first;
+			stats.types.push_back(each.second);
+		}
+	}
+
+	std::map<std::string, devicestats> devices;
+	deviceregistry::readstats(devices);
+
+	for (auto& each : devices)
+	{
+		each.second.name = each.first;
+		stats.devices.push_back(each.second);
+	}
+
+	return stats;
+}
+
+std::string logstats::summary() const
+{
+	uint64_t lines = 0, bytes = 0;
+	for (auto& each : types)
+	{
+		lines += each.lines;
+		bytes += each.bytes;
+	}
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "slog stats: %llu lines %llu bytes, %llu dropped %llu collapsed %llu filtered %llu exceptions",
+		(unsigned long long)lines, (unsigned long long)bytes, (unsigned long long)dropped, (unsigned long long)collapsed, (unsigned long long)filtered,
+		(unsigned long long)exceptions);
+
+	std::string out(buffer);
+	for (auto& each : devices)
+	{
+		snprintf(buffer, sizeof(buffer), "; %s %llu lines p50 %llu ns p99 %llu ns p999 %llu ns", each.name.c_str(), (unsigned long long)each.lines,
+			(unsigned long long)each.latency.percentile(0.5), (unsigned long long)each.latency.percentile(0.99), (unsigned long long)each.latency.percentile(0.999));
+		out += buffer;
+	}
+
+	return out;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+statsreporter::statsreporter(std::chrono::milliseconds interval, std::function<void(const logstats&)> report) :
+	_interval(interval), _report(std::move(report)), _stop(false)
+{
+	if (!_report)
+		_report = [](const logstats& stats) { slog::info() << stats.summary(); };
+
+	_thread = std::thread(&statsreporter::run, this);
+}
+
+statsreporter::~statsreporter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wakeup.notify_one();
+
+	_thread.join();
+}
+
+void statsreporter::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	for (;;)
+	{
+		const auto due = std::chrono::steady_clock::now() + _interval;
+		while (_stop == false && _wakeup.wait_until(lock, due) != std::cv_status::timeout)
+			;
+
+		if (_stop)
+			return;
+
+		lock.unlock();
+
+		// the suppressed lines of call sites nobody has come by since their report was due
+		loglimit::flushreports();
+
+		try
+		{
+			_report(logstats::snapshot());
+		}
+		catch (...)
+		{
+			std::cerr << "statsreporter caught an exception thrown by its report function" << std::endl;
+		}
+
+		lock.lock();
+	}
+}
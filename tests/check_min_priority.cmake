@@ -0,0 +1,22 @@
+# run by ctest: cmake -DNM=<nm> -DPROBE=<libslog_min_priority_probe.a> -P check_min_priority.cmake
+# the probe is built with SLOG_MIN_PRIORITY=150, front ends below that must not leave a single symbol behind
+
+execute_process(COMMAND ${NM} -C ${PROBE} OUTPUT_VARIABLE symbols RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "failed to run ${NM} on ${PROBE}")
+endif()
+
+foreach(stripped "slog::logobj<slog::logtype_info>" "slog::logobj<slog::logtype_debug>" "slog::logobj<slog::logtype_verbose>"
+	"slog::logobj<slog::logtype_success>" "slog::logobj<min_priority_trace>" "slog::binlogobj<slog::logtype_info>")
+	string(FIND "${symbols}" "${stripped}" found)
+	if(NOT found EQUAL -1)
+		message(FATAL_ERROR "${stripped} is below SLOG_MIN_PRIORITY but still in the probe")
+	endif()
+endforeach()
+
+foreach(kept "slog::logobj<slog::logtype_warn>" "slog::logobj<slog::logtype_error>" "slog::logobj<min_priority_audit>")
+	string(FIND "${symbols}" "${kept}" found)
+	if(found EQUAL -1)
+		message(FATAL_ERROR "${kept} is missing from the probe, the check above proves nothing")
+	endif()
+endforeach()
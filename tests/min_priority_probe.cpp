@@ -0,0 +1,76 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+// built with SLOG_MIN_PRIORITY=150 into its own library. slog_tests calls it to check nothing below the
+// threshold is logged or evaluated, and check_min_priority.cmake looks at its symbols to check nothing
+// below the threshold is left in the object code either
+
+#include <slog/slog.h>
+#include <slog/slog_binary.h>
+
+#if SLOG_MIN_PRIORITY != 150
+#error min_priority_probe.cpp has to be built with SLOG_MIN_PRIORITY=150
+#endif
+
+struct min_priority_audit : slog::logtype
+{
+	static const uint32_t Priority = 300;
+	min_priority_audit() : slog::logtype("audt", Priority, 0x61756474, slog::consolecolor::magenta) { }
+};
+
+struct min_priority_trace : slog::logtype
+{
+	static const uint32_t Priority = 10;
+	min_priority_trace() : slog::logtype("trce", Priority, 0x74726365, slog::consolecolor::gray) { }
+};
+
+typedef slog::selectlogobj<min_priority_audit>::type audit;
+typedef slog::selectlogobj<min_priority_trace>::type trace;
+
+static_assert(std::is_same<slog::info, slog::nooplogobj<slog::logtype_info>>::value, "info should be compiled out");
+static_assert(std::is_same<slog::debug, slog::nooplogobj<slog::logtype_debug>>::value, "debug should be compiled out");
+static_assert(std::is_same<slog::warn, slog::logobj<slog::logtype_warn>>::value, "warn should be kept");
+static_assert(std::is_same<trace, slog::nooplogobj<min_priority_trace>>::value, "custom types below the threshold should be compiled out");
+static_assert(std::is_same<audit, slog::logobj<min_priority_audit>>::value, "custom types above the threshold should be kept");
+
+// only the warn, error and audit lines should be logged, and only their arguments evaluated
+void min_priority_probe(uint32_t& evaluated)
+{
+	slog::verbose() << "verbose";
+	slog::debug() << "debug";
+	slog::info() << "info";
+	slog::success() << "success";
+	trace() << "trace";
+	slog::bin::info() << "bin info";
+
+	SLOG(slog::info) << "info " << ++evaluated;
+	SLOG(trace) << "trace " << ++evaluated;
+	SLOG_FMT(slog::debug, "debug {}", ++evaluated);
+
+	SLOG(slog::warn) << "warn " << ++evaluated;
+	SLOG_FMT(slog::error, "error {}", ++evaluated);
+	SLOG(audit) << "audit " << ++evaluated;
+}
@@ -31,15 +31,59 @@
 #include <slog/slog_logdevice_file.h>
 #include <slog/slog_logdevice_console.h>
 #include <slog/slog_logdevice_custom_function.h>
+#include <slog/slog_logdevice_binary_file.h>
+#include <slog/slog_binary.h>
+#include <slog/slog_logdevice_mmap.h>
+#include <slog/slog_logdevice_blockfile.h>
+#include <slog/slog_lz.h>
+#include <slog/slog_limit.h>
+#include <slog/slog_logdevice_flightrecorder.h>
+#include <slog/slog_logdevice_socket.h>
 
 #ifdef _MSC_VER
 #define unlink _unlink
 #else
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#ifdef SLOG_HAVE_ZLIB
+#include <zlib.h>
 #endif
 
 #include <cerrno>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+
+// every heap allocation in the test binary goes through here so tests can assert on allocation counts
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size)
+{
+	allocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
 
 void compare_file_contents(const char* filename, std::string contents, std::string errorstring)
 {
@@ -54,6 +98,48 @@ void compare_file_contents(const char* filename, std::string contents, std::stri
 		throw std::runtime_error(strobj() << errorstring);
 }
 
+std::string read_file(const char* filename)
+{
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+// reads a rotated segment, either filename.N or filename.N.gz
+bool read_segment(const std::string& filename, std::string& contents)
+{
+#ifdef SLOG_HAVE_ZLIB
+	gzFile file = gzopen((filename + ".gz").c_str(), "rb");
+	if (file)
+	{
+		char buffer[4096];
+		int length;
+		contents.clear();
+		while ((length = gzread(file, buffer, sizeof(buffer))) > 0)
+			contents.append(buffer, length);
+		gzclose(file);
+		return true;
+	}
+#endif
+
+	std::ifstream plain(filename.c_str());
+	if (plain.good() == false)
+		return false;
+
+	contents = read_file(filename.c_str());
+	return true;
+}
+
+void remove_segments(const std::string& filename, uint32_t count)
+{
+	for (uint32_t i = 1; i < count; i++)
+	{
+		unlink(std::string(strobj() << filename << "." << i).c_str());
+		unlink(std::string(strobj() << filename << "." << i << ".gz").c_str());
+	}
+}
+
 /// --- tests
 
 void emptylog(int argc, char* argv[])
@@ -115,57 +201,1997 @@ void empty_lines_should_print(int argc, char* argv[])
 	slog::info();
 }
 
-// -------------------------------------------------------------------------------------
+void async_logging_keeps_caller_latency_flat(int argc, char* argv[])
+{
+	const uint32_t lines = 100;
+	const auto sinkdelay = std::chrono::milliseconds(5);
+
+	uint32_t written = 0;
+	std::chrono::steady_clock::duration slowest(0);
+
+	// the device has to outlive the async config, which drains the queue into it on destruction
+	slog::logdevice_custom_function slowsink("console",
+		[&written, sinkdelay](const slog::logtype& type, const std::string& line)
+		{
+			std::this_thread::sleep_for(sinkdelay);
+			written++;
+		});
+
+	{
+		slog::logconfig asyncconfig;
+		asyncconfig.timestamps = false;
+		asyncconfig.startasync(lines * 2);
+
+		for (uint32_t i = 0; i < lines; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			slog::info() << "async line " << i;
+			slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+		}
+	}
+
+	if (written != lines)
+		throw std::runtime_error(strobj() << "async_logging_keeps_caller_latency_flat :: expected " << lines << " lines to be drained, got " << written);
+
+	if (slowest >= sinkdelay)
+		throw std::runtime_error(strobj() << "async_logging_keeps_caller_latency_flat :: a log call blocked on the slow device");
+}
+
+void async_writer_hands_devices_batches(int argc, char* argv[])
+{
+	const uint32_t lines = 2000;
+	const char logfilename[] = "batch.test.log";
+
+	std::atomic<bool> queued(false);
+	std::vector<std::string> batched;
+	uint32_t calls = 0;
+
+	// the first call holds the writer up until every line is queued, so the rest has to come in batches
+	slog::logdevice_custom_function batchsink("console", slog::logdevice_custom_function::batches(),
+		[&](const slog::logline* each, size_t count)
+		{
+			while (queued.load() == false)
+				std::this_thread::yield();
+
+			calls++;
+			for (size_t i = 0; i < count; i++)
+				batched.push_back(std::string(each[i].line, each[i].length));
+		});
+
+	std::vector<std::string> warnings;
+	slog::logdevice_custom_function warnsink("warnings", [&warnings](const slog::logtype& type, const std::string& line) { warnings.push_back(line); });
+	warnsink.setminpriority(slog::logtype_warn::Priority);
+
+	std::string expected;
+	{
+		slog::logdevice_file logfile(logfilename);
+
+		slog::logconfig asyncconfig;
+		asyncconfig.timestamps = false;
+		asyncconfig.print_logtype = false;
+		asyncconfig.startasync(lines * 2);
+
+		for (uint32_t i = 0; i < lines; i++)
+		{
+			if (i % 100 == 0)
+				slog::warn() << "line " << i;
+			else
+				slog::info() << "line " << i;
+
+			expected += strobj() << "line " << i << "\n";
+		}
+
+		queued = true;
+		asyncconfig.stopasync();
+	}
+
+	if (batched.size() != lines || batched[0] != "line 0" || batched[lines - 1] != (std::string)(strobj() << "line " << lines - 1))
+		throw std::runtime_error(strobj() << "async_writer_hands_devices_batches :: the batch device got " << batched.size() << " lines");
+
+	if (calls > 2 + lines / 128)
+		throw std::runtime_error(strobj() << "async_writer_hands_devices_batches :: " << lines << " lines took " << calls << " calls");
+
+	if (warnings.size() != lines / 100 || warnings[1] != "line 100")
+		throw std::runtime_error(strobj() << "async_writer_hands_devices_batches :: the warnings device got " << warnings.size() << " lines");
+
+	if (read_file(logfilename) != expected)
+		throw std::runtime_error("async_writer_hands_devices_batches :: the file device lost or reordered lines");
+}
+
+void async_can_stop_while_logging(int argc, char* argv[])
+{
+	const uint32_t threads = 4;
+	const uint32_t lines = 20000;
+
+	std::atomic<uint32_t> written(0);
+	slog::logdevice_custom_function counter("console", [&written](const slog::logtype& type, const std::string& line) { written++; });
+
+	slog::logconfig asyncconfig;
+	asyncconfig.timestamps = false;
+
+	std::atomic<uint32_t> running(threads);
+	std::vector<std::thread> loggers;
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		loggers.emplace_back([&running]()
+		{
+			for (uint32_t i = 0; i < lines; i++)
+				slog::info() << "line " << i;
+			running--;
+		});
+	}
+
+	// every line is either pushed to a writer that drains it or written straight to the devices
+	while (running.load() != 0)
+	{
+		asyncconfig.startasync(64);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		asyncconfig.stopasync();
+	}
+
+	for (auto& each : loggers)
+		each.join();
+
+	if (written.load() != threads * lines)
+		throw std::runtime_error(strobj() << "async_can_stop_while_logging :: " << threads * lines << " lines logged but " << written.load() << " written");
+}
+
+void async_batch_survives_a_throwing_device(int argc, char* argv[])
+{
+	const uint32_t lines = 500;
+
+	// registered first, so it gets each batch before the device that keeps the lines
+	slog::logdevice_custom_function thrower("a_thrower", slog::logdevice_custom_function::batches(),
+		[](const slog::logline* each, size_t count) { throw std::runtime_error("device failed"); });
+
+	std::vector<std::string> kept;
+	slog::logdevice_custom_function keeper("console", slog::logdevice_custom_function::batches(),
+		[&kept](const slog::logline* each, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				kept.push_back(std::string(each[i].line, each[i].length));
+		});
+
+	const uint64_t before = slog::logstats::snapshot().exceptions;
+
+	{
+		slog::logconfig asyncconfig;
+		asyncconfig.timestamps = false;
+		asyncconfig.print_logtype = false;
+		asyncconfig.startasync(lines * 2);
+
+		for (uint32_t i = 0; i < lines; i++)
+			slog::info() << "line " << i;
+	}
+
+	if (kept.size() != lines)
+		throw std::runtime_error(strobj() << "async_batch_survives_a_throwing_device :: the other device got " << kept.size() << " of " << lines << " lines");
+
+	if (slog::logstats::snapshot().exceptions == before)
+		throw std::runtime_error("async_batch_survives_a_throwing_device :: the exceptions were not counted");
+}
+
+void devices_can_come_and_go_while_logging(int argc, char* argv[])
+{
+	const uint32_t threads = 4;
+	const uint32_t lines = 2000;
+
+	std::atomic<uint32_t> written(0);
+	std::atomic<bool> done(false);
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+
+	slog::logdevice_custom_function counter("console",
+		[&written](const slog::logtype& type, const std::string& line)
+		{
+			written++;
+		});
+
+	std::vector<std::thread> loggers;
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		loggers.emplace_back([lines]()
+		{
+			for (uint32_t i = 0; i < lines; i++)
+				slog::info() << "line " << i;
+		});
+	}
+
+	std::thread churn([&done]()
+	{
+		while (done == false)
+		{
+			slog::logdevice_custom_function transient("transient",
+				[](const slog::logtype& type, const std::string& line) { });
+		}
+	});
+
+	for (auto& each : loggers)
+		each.join();
+
+	done = true;
+	churn.join();
+
+	if (written != threads * lines)
+		throw std::runtime_error(strobj() << "devices_can_come_and_go_while_logging :: expected " << threads * lines << " lines, got " << written);
+}
+
+void devices_cannot_be_added_from_a_device(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+
+	// the device would otherwise wait for the reader of the line it is writing
+	bool refused = false;
+	slog::logdevice_custom_function nesting("console",
+		[&refused](const slog::logtype& type, const std::string& line)
+		{
+			try
+			{
+				slog::logdevice_custom_function nested("nested", [](const slog::logtype& type, const std::string& line) { });
+			}
+			catch (std::logic_error&)
+			{
+				refused = true;
+			}
+		});
+
+	slog::info() << "add a device from in here";
+
+	if (refused == false)
+		throw std::runtime_error("devices_cannot_be_added_from_a_device :: adding a device from a device was not refused");
+}
+
+class counting_logdevice : public slog::logdevice
+{
+	public:
+		counting_logdevice(const std::string& name) : slog::logdevice(name, false), lines(0), bytes(0) { attach(); }
+		~counting_logdevice() { detach(); }
+
+		void writelogline(const slog::logtype& type, const char* line, size_t length) override
+		{
+			lines++;
+			bytes += length;
+		}
 
-#define TIMES 20000
+		uint64_t lines;
+		uint64_t bytes;
+};
 
-#include <iostream>
+void logging_does_not_allocate_in_steady_state(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	counting_logdevice counter("console");
+
+	// the first lines grow the per-thread buffers to size
+	for (uint32_t i = 0; i < 10; i++)
+		slog::info() << "complex " << "string" << " " << 10 << " " << 30.001f << " " << std::string("short");
+
+	const uint64_t before = allocations;
+
+	for (uint32_t i = 0; i < 1000; i++)
+		slog::info() << "complex " << "string" << " " << 10 << " " << 30.001f << " " << std::string("short");
+
+	const uint64_t allocated = allocations - before;
+
+	if (counter.lines != 1010)
+		throw std::runtime_error(strobj() << "logging_does_not_allocate_in_steady_state :: expected 1010 lines, got " << counter.lines);
+
+	if (allocated != 0)
+		throw std::runtime_error(strobj() << "logging_does_not_allocate_in_steady_state :: " << allocated << " allocations for 1000 lines");
+}
+
+void utc_timestamps_with_subsecond_precision(int argc, char* argv[])
+{
+	std::string captured;
+
+	slog::logconfig curconfig;
+	curconfig.print_logtype = false;
+	curconfig.utc_timestamps = true;
+
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured = line;
+		});
+
+	auto isdigits = [](const std::string& s, size_t from, size_t count)
+	{
+		for (size_t i = from; i < from + count; i++)
+			if (i >= s.size() || s[i] < '0' || s[i] > '9')
+				return false;
+		return true;
+	};
+
+	// [2014-06-01T13:45:10.250Z] - msg
+	curconfig.timestamp_precision = slog::timestampprecision::milliseconds;
+	slog::info() << "msg";
+	if (captured.size() != 32 || captured[11] != 'T' || captured[20] != '.' || isdigits(captured, 21, 3) == false || captured.compare(24, 8, "Z] - msg") != 0)
+		throw std::runtime_error(strobj() << "utc_timestamps_with_subsecond_precision :: unexpected millisecond timestamp '" << captured << "'");
+
+	// [2014-06-01T13:45:10.250123Z] - msg
+	curconfig.timestamp_precision = slog::timestampprecision::microseconds;
+	slog::info() << "msg";
+	if (captured.size() != 35 || isdigits(captured, 21, 6) == false || captured.compare(27, 8, "Z] - msg") != 0)
+		throw std::runtime_error(strobj() << "utc_timestamps_with_subsecond_precision :: unexpected microsecond timestamp '" << captured << "'");
+
+	// the year must agree with gmtime, the cached prefix is shared with local time lines on this thread
+	time_t now = std::time(nullptr);
+	tm utc;
+#ifdef _WIN32
+	gmtime_s(&utc, &now);
+#else
+	gmtime_r(&now, &utc);
+#endif
+	if (std::atoi(captured.substr(1, 4).c_str()) != 1900 + utc.tm_year)
+		throw std::runtime_error(strobj() << "utc_timestamps_with_subsecond_precision :: year does not match gmtime '" << captured << "'");
+
+	curconfig.utc_timestamps = false;
+	curconfig.timestamp_precision = slog::timestampprecision::seconds;
+	slog::info() << "msg";
+	if (captured.size() != 27 || captured[11] != ' ' || captured.compare(20, 8, "] - msg") != 0)
+		throw std::runtime_error(strobj() << "utc_timestamps_with_subsecond_precision :: unexpected local timestamp '" << captured << "'");
+}
+
+struct point
+{
+	int x;
+	int y;
+};
+
+std::ostream& operator<< (std::ostream& out, const point& p)
+{
+	return out << "(" << p.x << "," << p.y << ")";
+}
+
+template<typename INFO, typename WARN>
+void log_every_argument_kind()
+{
+	const point p = { 3, -4 };
+	const char* ptr = "pointer";
+
+	INFO() << "ints " << -42 << " " << 42u << " " << (int64_t)-1 << " " << (uint64_t)18446744073709551615ull << " " << (short)-7;
+	INFO() << "floats " << 30.001f << " " << 1.0 / 3 << " " << 1e300 << " " << -0.5;
+	INFO() << "chars " << 'x' << (unsigned char)'y' << " bools " << true << false;
+	WARN() << "strings " << std::string("std::string") << " " << ptr << " custom " << p;
+	WARN();
+}
 
-void bench(int argc, char* argv[])
+void binary_log_round_trips_to_text(int argc, char* argv[])
 {
-	std::ostringstream ss;
-	
+	const char logfilename[] = "binarylog.test.slogbin";
+
 	slog::logconfig curconfig;
-	curconfig.timestamps = curconfig.print_logtype = curconfig.usecolor = false;
+	curconfig.timestamps = false;
+
+	std::vector<std::string> expected;
 
-	for (int i = 1; i < argc; i++)
 	{
-		ss << argv[i] << " ";
+		slog::logdevice_custom_function capture("console",
+			[&expected](const slog::logtype& type, const std::string& line)
+			{
+				expected.push_back(line);
+			});
+
+		slog::logdevice_binary_file binfile(logfilename);
+
+		log_every_argument_kind<slog::info, slog::warn>();
+		log_every_argument_kind<slog::bin::info, slog::bin::warn>();
 	}
 
-	if (ss.str().find("-t1") != std::string::npos)
+	std::vector<std::string> records;
+	std::vector<std::string> lines;
+
+	slog::binarylogreader reader(logfilename);
+	slog::binarylogreader::entry e;
+	slog::linebuffer formatted;
+
+	while (reader.next(e))
 	{
-		for (uint32_t i = 0; i < TIMES; i++)
-			printf("complex %s %d %f\n", "string", 10, 30.f);
+		if (e.preformatted)
+		{
+			lines.push_back(e.text);
+		}
+		else
+		{
+			slog::logconfig::formatmsg(*e.type, e.text.data(), e.text.size(), formatted, e.when);
+			records.push_back(std::string(formatted.data(), formatted.size()));
+		}
+	}
+
+	if (lines != expected)
+		throw std::runtime_error(strobj() << "binary_log_round_trips_to_text :: text lines stored in the binary log do not match");
 
-		exit(0);
+	if (records.size() != expected.size())
+		throw std::runtime_error(strobj() << "binary_log_round_trips_to_text :: expected " << expected.size() << " records, got " << records.size());
+
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (records[i] != expected[i])
+			throw std::runtime_error(strobj() << "binary_log_round_trips_to_text :: decoded '" << records[i] << "' expected '" << expected[i] << "'");
 	}
-	else if (ss.str().find("-t2") != std::string::npos)
+
+	// records below the minimum of every device are neither encoded nor written
+	const uint64_t filtered = slog::logstats::snapshot().filtered;
 	{
-		for (uint32_t i = 0; i < TIMES; i++)
-			slog::info() << "complex " << "string" << " " << 10 << " " << 30.001f;
+		slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+		quiet.setminpriority(slog::logtype_error::Priority);
+
+		slog::logdevice_binary_file binfile(logfilename);
+		binfile.setminpriority(slog::logtype_warn::Priority);
 
-		exit(1);
+		slog::bin::info() << "below";
+		slog::bin::warn() << "at";
 	}
-	else if (ss.str().find("-t3") != std::string::npos)
+
+	if (slog::logstats::snapshot().filtered == filtered)
+		throw std::runtime_error("binary_log_round_trips_to_text :: a record no device takes was not counted as filtered");
+
+	slog::binarylogreader filteredreader(logfilename);
+	records.clear();
+	while (filteredreader.next(e))
+		records.push_back(e.text);
+
+	if (records.size() != 1 || records[0] != "at")
+		throw std::runtime_error(strobj() << "binary_log_round_trips_to_text :: expected only the warn record, got " << records.size());
+}
+
+void fmt_matches_stream_output(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	const point p = { 3, -4 };
+	const char* ptr = "pointer";
+
+	slog::info() << "ints " << -42 << " " << 42u << " " << (int64_t)-9223372036854775807ll - 1 << " " << (uint64_t)18446744073709551615ull << " " << (short)-7
+		<< " floats " << 30.001f << " " << 1.0 / 3 << " " << 1e300 << " " << -0.5
+		<< " chars " << 'x' << (unsigned char)'y' << " bools " << true << false
+		<< " strings " << std::string("std::string") << " " << ptr << " custom " << p << " braces {} {x}";
+
+	SLOG_FMT(slog::info, "ints {} {} {} {} {} floats {} {} {} {} chars {}{} bools {}{} strings {} {} custom {} braces {{}} {{x}}",
+		-42, 42u, (int64_t)-9223372036854775807ll - 1, (uint64_t)18446744073709551615ull, (short)-7,
+		30.001f, 1.0 / 3, 1e300, -0.5,
+		'x', (unsigned char)'y', true, false,
+		std::string("std::string"), ptr, p);
+
+	SLOG_FMT(slog::info, "no arguments");
+	slog::info() << "no arguments";
+
+	if (captured.size() != 4 || captured[0] != captured[1] || captured[2] != captured[3])
+		throw std::runtime_error(strobj() << "fmt_matches_stream_output :: fmt and operator<< disagree '" << (captured.size() > 1 ? captured[1] : "") << "'");
+
+	// disabled and compiled out levels must not evaluate their arguments
+	uint32_t evaluated = 0;
+	SLOG_FMT(slog::debug, "{}", ++evaluated);
+	SLOG_FMT(slog::nooplogobj<slog::logtype_info>, "{}", ++evaluated);
+
+	if (evaluated != 0 || captured.size() != 4)
+		throw std::runtime_error(strobj() << "fmt_matches_stream_output :: arguments of a disabled level were evaluated");
+
+	// longer than the default constexpr recursion depth, the placeholders are still counted at compile time
+#define FMT_LONG_TEXT "a format string that goes on and on without any placeholders to fill in, "
+	SLOG_FMT(slog::info, FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT FMT_LONG_TEXT
+		FMT_LONG_TEXT FMT_LONG_TEXT "{} then {}", 1, 2);
+#undef FMT_LONG_TEXT
+
+	if (captured.size() != 5 || captured[4].size() < 700 || captured[4].compare(captured[4].size() - 8, 8, "1 then 2") != 0)
+		throw std::runtime_error(strobj() << "fmt_matches_stream_output :: a long format string came out as '" << (captured.size() > 4 ? captured[4] : "") << "'");
+
+	// a null string reads the same on every path, including the stream once a manipulator took over
+	const char* none = nullptr;
+	captured.clear();
+	slog::info() << "null " << none << " rest";
+	SLOG_FMT(slog::info, "null {} rest", none);
+	slog::info() << std::hex << "null " << none << " rest";
+	slog::info().kv("null", none) << "kv";
+
+	if (captured.size() != 4 || captured[0].find("null (null) rest") == std::string::npos || captured[1] != captured[0] || captured[2] != captured[0] ||
+		captured[3].find("null=(null)") == std::string::npos)
+		throw std::runtime_error(strobj() << "fmt_matches_stream_output :: a null string came out as '" << (captured.empty() ? "" : captured.back()) << "'");
+}
+
+// the reference output of a value is whatever a fresh ostringstream makes of it
+template<typename T>
+void expect_stream_output(const T& value, std::vector<std::string>& captured)
+{
+	std::ostringstream expected;
+	expected << value;
+
+	const std::string fromstrobj = strobj() << value;
+	slog::info() << value;
+
+	if (fromstrobj != expected.str() || captured.empty() || captured.back() != expected.str())
+		throw std::runtime_error(strobj() << "operator<< formats a value as '" << fromstrobj << "' and '" << (captured.empty() ? "" : captured.back())
+			<< "' instead of '" << expected.str() << "'");
+}
+
+void formatting_matches_ostream(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	expect_stream_output(0, captured);
+	expect_stream_output(7, captured);
+	expect_stream_output(-10, captured);
+	expect_stream_output(99u, captured);
+	expect_stream_output(100, captured);
+	expect_stream_output((int64_t)-9223372036854775807ll - 1, captured);
+	expect_stream_output((uint64_t)18446744073709551615ull, captured);
+	expect_stream_output((short)-32768, captured);
+	expect_stream_output('x', captured);
+	expect_stream_output(true, captured);
+	expect_stream_output("literal", captured);
+	expect_stream_output(std::string("std::string"), captured);
+
+	const point p = { 3, -4 };
+	expect_stream_output(p, captured);
+
+	const double doubles[] = { 0.0, -0.0, 30.001f, 1.0 / 3, -0.5, 1e300, 1e-300, 5e-324, 123456.5, 999999.5, 9999995.0, 0.0001, 0.00001,
+		0.000123456789, 1e15, 1e16, 1e22, 1e23, 100000, 1000000, 0.1 + 0.2, std::numeric_limits<double>::max(),
+		std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() };
+	for (double d : doubles)
+		expect_stream_output(d, captured);
+
+	// every decimal exponent with values picked from the whole mantissa range, the same for floats
+	uint64_t seed = 88172645463325252ull;
+	for (int i = 0; i < 20000; i++)
 	{
-		for (uint32_t i = 0; i < TIMES; i++)
-			std::cout << "complex " << "string" << " " << 10 << " " << 30.001f << std::endl;
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
 
-		exit(1);
+		const double d = (double)(seed >> 11) / (double)(1ull << 53) * std::pow(10.0, (double)(int)(seed % 61) - 30);
+		expect_stream_output(d, captured);
+		expect_stream_output((float)-d, captured);
+
+		// short decimals land on and around the rounding boundaries
+		expect_stream_output((double)(seed % 20000000) / 10.0, captured);
 	}
+
+	// manipulators change how the stream formats, those values are left to it
+	const std::string hex = strobj() << std::hex << 255 << " " << std::setw(5) << 7 << std::dec << " " << std::setprecision(10) << 1.0 / 3 << " " << std::fixed << 30.001f;
+	slog::info() << std::hex << 255 << " " << std::setw(5) << 7 << std::dec << " " << std::setprecision(10) << 1.0 / 3 << " " << std::fixed << 30.001f;
+
+	if (hex != "ff     7 0.3333333333 30.0009994507" || captured.back() != hex)
+		throw std::runtime_error(strobj() << "formatting_matches_ostream :: manipulators were not applied '" << hex << "' '" << captured.back() << "'");
+
+	// and are gone on the next line
+	slog::info() << 255 << " " << 1.0 / 3;
+	if (captured.back() != "255 0.333333")
+		throw std::runtime_error(strobj() << "formatting_matches_ostream :: manipulators carried over to the next line '" << captured.back() << "'");
 }
 
-int main(int argc, char* argv[])
+void cycle_counter_timestamps_track_the_system_clock(int argc, char* argv[])
 {
-	bench(argc, argv);
+	using namespace std::chrono;
 
-	try
+	// recalibrating often puts the slewing through its paces in a short run
+	slog::logclock::setcalibrationinterval(milliseconds(20));
+
+	const auto tolerance = milliseconds(2);
+	const auto deadline = steady_clock::now() + milliseconds(300);
+	auto previous = slog::logclock::now();
+	nanoseconds drift(0);
+
+	while (steady_clock::now() < deadline)
 	{
-		emptylog(argc, argv);
-		simple_log_line(argc, argv);
-		default_verbose_debug_off(argc, argv);
-		empty_lines_should_print(argc, argv);
+		const auto before = system_clock::now();
+		const auto stamp = slog::logclock::now();
+		const auto after = system_clock::now();
+
+		if (stamp < previous)
+			throw std::runtime_error("cycle_counter_timestamps_track_the_system_clock :: the clock went backwards");
+		previous = stamp;
+
+		drift = std::max(drift, duration_cast<nanoseconds>(std::max(before - stamp, stamp - after)));
+		if (stamp < before - tolerance || stamp > after + tolerance)
+			throw std::runtime_error(strobj() << "cycle_counter_timestamps_track_the_system_clock :: drifted " << duration_cast<microseconds>(drift).count() << "us from the system clock");
+	}
+
+	// each stamp is taken under the lock, so it may never be older than the one the previous thread took
+	std::mutex lock;
+	auto last = slog::logclock::now();
+	std::atomic<bool> backwards(false);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int i = 0; i < 20000; i++)
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				const auto stamp = slog::logclock::now();
+				if (stamp < last)
+					backwards = true;
+				last = stamp;
+			}
+		});
+	}
+
+	for (auto& each : threads)
+		each.join();
+
+	slog::logclock::setcalibrationinterval(seconds(1));
+
+	if (backwards)
+		throw std::runtime_error("cycle_counter_timestamps_track_the_system_clock :: a thread saw an older timestamp than the one before it");
+
+	// lines carry the same time either way, fixed width UTC stamps compare as text
+	slog::logconfig curconfig;
+	curconfig.timestamp_source = slog::timestampsource::cyclecounter;
+	curconfig.timestamp_precision = slog::timestampprecision::microseconds;
+	curconfig.utc_timestamps = true;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	slog::linebuffer earliest, latest;
+	slog::logconfig::formatmsg(slog::info::type, "", 0, earliest, system_clock::now() - tolerance);
+	slog::info() << "stamped";
+	slog::logconfig::formatmsg(slog::info::type, "", 0, latest, system_clock::now() + tolerance);
+
+	const std::string lower(earliest.data(), earliest.size()), upper(latest.data(), latest.size());
+	if (captured.size() != 1 || captured[0] < lower || captured[0].substr(0, upper.size()) > upper)
+		throw std::runtime_error(strobj() << "cycle_counter_timestamps_track_the_system_clock :: '" << (captured.empty() ? "" : captured[0]) << "' is not between '" << lower << "' and '" << upper << "'");
+}
+
+void lazy_arguments_are_not_evaluated(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	uint32_t evaluated = 0;
+	auto sideeffect = [&evaluated]() { return ++evaluated; };
+
+	// debug is off at runtime, noop stands in for a level compiled out with SLOG_DISABLE_*
+	typedef slog::nooplogobj<slog::logtype_info> noop;
+
+	SLOG(slog::debug) << "debug " << sideeffect();
+	SLOG(noop) << "noop " << sideeffect();
+	slog::debug([&](std::ostream& s) { s << "debug " << sideeffect(); });
+	noop([&](std::ostream& s) { s << "noop " << sideeffect(); });
+
+	if (evaluated != 0 || captured.empty() == false)
+		throw std::runtime_error(strobj() << "lazy_arguments_are_not_evaluated :: " << evaluated << " arguments of disabled levels were evaluated");
+
+	SLOG(slog::info) << "info " << sideeffect();
+	slog::info([&](std::ostream& s) { s << "info " << sideeffect(); });
+
+	// the macro must not steal the else of an enclosing if
+	if (evaluated == 0)
+		SLOG(slog::info) << "wrong branch";
+	else
+		slog::info() << "right branch";
+
+	if (evaluated != 2 || captured.size() != 3 || captured[0] != "info 1" || captured[1] != "info 2" || captured[2] != "right branch")
+		throw std::runtime_error(strobj() << "lazy_arguments_are_not_evaluated :: enabled levels did not log as expected");
+}
+
+void categories_inherit_levels(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	slog::logcategory& pool = slog::logcategory::get("db.pool");
+	slog::logcategory& http = slog::logcategory::get("net.http");
+	slog::logcategory& client = slog::logcategory::get("net.http.client");
+	slog::logcategory& cache = slog::logcategory::get("cache");
+
+	const char* args[] = { "tests", "--log=db.*:debug", "--log=net:warn", "--log=net.http.client:info", "--log=bogus:loud" };
+	curconfig.parse(sizeof(args) / sizeof(args[0]), (char**)args);
+
+	// created after the rules, still has to pick up db.*
+	slog::logcategory& replica = slog::logcategory::get("db.replica");
+
+	if (&slog::logcategory::get("db.pool") != &pool)
+		throw std::runtime_error(strobj() << "categories_inherit_levels :: the same name gave two categories");
+
+	slog::debug(pool) << "pool debug";
+	slog::debug(replica) << "replica debug";
+	slog::info(http) << "http info";
+	slog::warn(http) << "http warn";
+	slog::debug(client) << "client debug";
+	slog::info(client) << "client info";
+	slog::debug(cache) << "cache debug";
+	slog::info(cache) << "cache info";
+
+	uint32_t evaluated = 0;
+	SLOG_CATEGORY(slog::info, http) << "http info " << ++evaluated;
+
+	const char* expected[] = { "[db.pool] pool debug", "[db.replica] replica debug", "[net.http] http warn", "[net.http.client] client info", "[cache] cache info" };
+	const size_t count = sizeof(expected) / sizeof(expected[0]);
+
+	if (captured.size() != count || std::equal(expected, expected + count, captured.begin()) == false || evaluated != 0)
+		throw std::runtime_error(strobj() << "categories_inherit_levels :: expected " << count << " lines, got " << captured.size());
+
+	captured.clear();
+	slog::logcategory::setlevel("*", slog::logcategory::off);
+	slog::logcategory::setlevel("db.*", slog::logcategory::unset);
+
+	slog::error(pool) << "pool error";
+	slog::info(client) << "client info";
+
+	slog::logcategory::clearlevels();
+
+	slog::info(pool) << "pool info";
+	slog::debug(pool) << "pool debug";
+
+	if (captured.size() != 2 || captured[0] != "[net.http.client] client info" || captured[1] != "[db.pool] pool info")
+		throw std::runtime_error(strobj() << "categories_inherit_levels :: removing rules did not fall back to the parents");
+}
+
+void call_site_limits(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> captured;
+	std::mutex capturedmutex;
+	slog::logdevice_custom_function capture("console",
+		[&captured, &capturedmutex](const slog::logtype& type, const std::string& line)
+		{
+			std::lock_guard<std::mutex> lock(capturedmutex);
+			captured.push_back(line);
+		});
+
+	auto count = [&captured](const std::string& prefix)
+	{
+		return (size_t)std::count_if(captured.begin(), captured.end(), [&prefix](const std::string& line) { return line.compare(0, prefix.size(), prefix) == 0; });
+	};
+
+	uint32_t evaluated = 0;
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		SLOG_FIRST(slog::info, 5) << "first " << ++evaluated;
+		SLOG_SAMPLE(slog::info, 100) << "sample " << i;
+		SLOG_RATELIMIT(slog::info, 50) << "rate " << i;
+	}
+
+	// a burst is at most a second worth of lines, the loop may run long enough to earn one more token
+	if (evaluated != 5 || count("first ") != 5 || count("sample ") != 10 || count("rate ") < 50 || count("rate ") > 52)
+		throw std::runtime_error(strobj() << "call_site_limits :: limits let through " << count("first ") << "/" << count("sample ") << "/" << count("rate ") << " lines");
+
+	if (captured[0] != "first 1" || captured[1] != "sample 0" || captured[2] != "rate 0")
+		throw std::runtime_error(strobj() << "call_site_limits :: unexpected first lines");
+
+	// several threads on one limiter, reported right away so every dropped line has to show up in a report
+	slog::loglimit::flushreports(true);
+	captured.clear();
+	slog::firstlimit shared(100, std::chrono::milliseconds(0));
+
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([&shared]()
+		{
+			for (uint32_t i = 0; i < 10000; i++)
+				SLOG_LIMIT(slog::info, shared) << "shared " << i;
+		}));
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	// whatever the call site did not get to report yet
+	slog::loglimit::flushreports(true);
+
+	uint64_t reported = 0;
+	for (auto& line : captured)
+	{
+		unsigned long long suppressed = 0;
+		if (sscanf(line.c_str(), "%llu lines suppressed at", &suppressed) == 1)
+			reported += suppressed;
+	}
+
+	const uint64_t dropped = 4 * 10000 - 100;
+	if (count("shared ") != 100 || reported != dropped)
+		throw std::runtime_error(strobj() << "call_site_limits :: " << count("shared ") << " shared lines, " << reported << " reported as suppressed");
+}
+
+void repeated_lines_are_collapsed(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> captured;
+	std::mutex capturedmutex;
+	slog::logdevice_custom_function capture("console",
+		[&captured, &capturedmutex](const slog::logtype& type, const std::string& line)
+		{
+			std::lock_guard<std::mutex> lock(capturedmutex);
+			captured.push_back(line);
+		});
+
+	curconfig.startrepeatfilter(std::chrono::seconds(10));
+
+	for (uint32_t i = 0; i < 5; i++)
+		slog::info() << "storm";
+	slog::info() << "calm";
+	slog::info() << "calm";
+	slog::warn() << "storm"; // other types keep their own previous line
+	slog::info() << "done";
+
+	curconfig.stoprepeatfilter();
+
+	const char* expected[] = { "storm", "last message repeated 4 times", "calm", "storm", "last message repeated 1 time", "done" };
+	const size_t count = sizeof(expected) / sizeof(expected[0]);
+
+	if (captured.size() != count || std::equal(expected, expected + count, captured.begin()) == false)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: expected " << count << " lines, got " << captured.size());
+
+	// repeats that go quiet are summarized once the timeout passes
+	captured.clear();
+	curconfig.startrepeatfilter(std::chrono::milliseconds(20));
+
+	for (uint32_t i = 0; i < 3; i++)
+		slog::info() << "quiet";
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+	{
+		std::lock_guard<std::mutex> lock(capturedmutex);
+		if (captured.size() != 2 || captured[1] != "last message repeated 2 times")
+			throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: no summary after the timeout");
+	}
+
+	// interleaved producers: every line has to be accounted for, either written or counted by a summary,
+	// and the devices see the lines in the order the filter decided on them
+	curconfig.stoprepeatfilter();
+	curconfig.startrepeatfilter(std::chrono::seconds(10));
+	captured.clear();
+	const uint64_t collapsed = slog::logstats::snapshot().collapsed;
+
+	const uint32_t threads = 4;
+	const uint32_t lines = 5000;
+
+	std::vector<std::thread> producers;
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		producers.push_back(std::thread([t, lines]()
+		{
+			for (uint32_t i = 0; i < lines; i++)
+				slog::info() << "producer " << t;
+		}));
+	}
+
+	for (auto& producer : producers)
+		producer.join();
+
+	curconfig.stoprepeatfilter();
+
+	uint64_t accounted = 0;
+	uint64_t summarized = 0;
+	const std::string* previous = nullptr;
+	for (auto& line : captured)
+	{
+		// a summary follows the message it counts, and a message written twice in a row was not collapsed
+		unsigned long long repeats = 0;
+		if (sscanf(line.c_str(), "last message repeated %llu", &repeats) == 1)
+		{
+			if (previous == nullptr || previous->compare(0, 4, "last") == 0)
+				throw std::runtime_error("repeated_lines_are_collapsed :: a summary was written without the message it counts");
+			accounted += repeats;
+			summarized += repeats;
+		}
+		else
+		{
+			if (previous && *previous == line)
+				throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: '" << line << "' was written twice in a row");
+			accounted++;
+		}
+		previous = &line;
+	}
+
+	if (accounted != threads * lines)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: accounted for " << accounted << " of " << threads * lines << " lines");
+
+	if (slog::logstats::snapshot().collapsed - collapsed != summarized)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: " << summarized << " lines summarized but " << slog::logstats::snapshot().collapsed - collapsed << " counted as collapsed");
+
+	if (captured.size() >= threads * lines)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: nothing was collapsed");
+
+	// a line held up by a slow device is not overtaken by the summary and the line another thread logs after it
+	captured.clear();
+	curconfig.startrepeatfilter(std::chrono::seconds(10));
+
+	{
+		std::atomic<bool> entered(false), release(false);
+
+		// same name, so it stands in for the capture device until it goes out of scope
+		slog::logdevice_custom_function slow("console",
+			[&captured, &capturedmutex, &entered, &release](const slog::logtype& type, const std::string& line)
+			{
+				if (line == "held" && entered.exchange(true) == false)
+				{
+					while (release == false)
+						std::this_thread::yield();
+				}
+
+				std::lock_guard<std::mutex> lock(capturedmutex);
+				captured.push_back(line);
+			});
+
+		std::thread first([]() { slog::info() << "held"; });
+		while (entered == false)
+			std::this_thread::yield();
+
+		std::thread second([]() { slog::info() << "held"; slog::info() << "after"; });
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		release = true;
+
+		first.join();
+		second.join();
+	}
+
+	curconfig.stoprepeatfilter();
+
+	const char* held[] = { "held", "last message repeated 1 time", "after" };
+	if (captured.size() != 3 || std::equal(held, held + 3, captured.begin()) == false)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: a held line was overtaken, got '" << (captured.empty() ? "" : captured[0]) << "' first");
+
+	// a device that logs while it is being written to must not deadlock on the filter
+	captured.clear();
+	curconfig.startrepeatfilter(std::chrono::seconds(10));
+
+	{
+		// same name, so it stands in for the capture device until it goes out of scope
+		slog::logdevice_custom_function reentrant("console",
+			[&captured, &capturedmutex](const slog::logtype& type, const std::string& line)
+			{
+				{
+					std::lock_guard<std::mutex> lock(capturedmutex);
+					captured.push_back(line);
+				}
+
+				if (line == "outer")
+					slog::warn() << "inner";
+			});
+
+		slog::info() << "outer";
+	}
+
+	curconfig.stoprepeatfilter();
+
+	if (std::count(captured.begin(), captured.end(), "inner") != 1)
+		throw std::runtime_error(strobj() << "repeated_lines_are_collapsed :: the line logged from inside a device was lost");
+}
+
+void structured_fields_per_layout(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> text, json, logfmt;
+	slog::logdevice_custom_function textdevice("console", [&text](const slog::logtype& type, const std::string& line) { text.push_back(line); });
+	slog::logdevice_custom_function jsondevice("json", [&json](const slog::logtype& type, const std::string& line) { json.push_back(line); });
+	slog::logdevice_custom_function logfmtdevice("logfmt", [&logfmt](const slog::logtype& type, const std::string& line) { logfmt.push_back(line); });
+
+	jsondevice.setlayout(slog::loglayout::json);
+	logfmtdevice.setlayout(slog::loglayout::logfmt);
+
+	const point p = { 3, -4 };
+	slog::info().kv("user", 42).kv("ms", 3.5).kv("name", "a \"b\"").kv("ok", true).kv("neg", (int64_t)-7).kv("at", p).kv("raw", "tab\there") << "request " << "done";
+	slog::warn() << "plain";
+
+	const char* expected[][3] = {
+		{ "request done user=42 ms=3.5 name=\"a \\\"b\\\"\" ok=true neg=-7 at=(3,-4) raw=\"tab\\there\"",
+		  "{\"level\":\"info\",\"msg\":\"request done\",\"user\":42,\"ms\":3.5,\"name\":\"a \\\"b\\\"\",\"ok\":true,\"neg\":-7,\"at\":\"(3,-4)\",\"raw\":\"tab\\there\"}",
+		  "level=info msg=\"request done\" user=42 ms=3.5 name=\"a \\\"b\\\"\" ok=true neg=-7 at=(3,-4) raw=\"tab\\there\"" },
+		{ "plain", "{\"level\":\"warn\",\"msg\":\"plain\"}", "level=warn msg=plain" },
+	};
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (text.size() != 2 || text[i] != expected[i][0])
+			throw std::runtime_error(strobj() << "structured_fields_per_layout :: text line '" << (i < text.size() ? text[i] : "") << "'");
+		if (json.size() != 2 || json[i] != expected[i][1])
+			throw std::runtime_error(strobj() << "structured_fields_per_layout :: json line '" << (i < json.size() ? json[i] : "") << "'");
+		if (logfmt.size() != 2 || logfmt[i] != expected[i][2])
+			throw std::runtime_error(strobj() << "structured_fields_per_layout :: logfmt line '" << (i < logfmt.size() ? logfmt[i] : "") << "'");
+	}
+
+	curconfig.timestamps = true;
+	curconfig.utc_timestamps = true;
+	slog::info().kv("n", 1) << "stamped";
+
+	if (json.size() != 3 || json[2].compare(0, 9, "{\"time\":\"") != 0 || json[2].find("Z\",\"level\":\"info\",\"msg\":\"stamped\",\"n\":1}") == std::string::npos)
+		throw std::runtime_error(strobj() << "structured_fields_per_layout :: json line with a timestamp '" << json.back() << "'");
+}
+
+void per_device_priority_and_layout(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::debug::type.enabled = true;
+
+	std::vector<std::string> console, file;
+	slog::logdevice_custom_function consoledevice("console", [&console](const slog::logtype& type, const std::string& line) { console.push_back(line); });
+	slog::logdevice_custom_function filedevice("file", [&file](const slog::logtype& type, const std::string& line) { file.push_back(line); });
+
+	// warnings and up on the console, everything from debug up in the file as JSON
+	consoledevice.setminpriority(slog::logtype_warn::Priority);
+	filedevice.setminpriority(slog::logtype_debug::Priority);
+	filedevice.setlayout(slog::loglayout::json);
+
+	slog::debug() << "debug";
+	slog::info() << "info";
+	slog::warn() << "warn";
+	slog::error() << "error";
+
+	const char* expectedfile[] = { "{\"level\":\"debg\",\"msg\":\"debug\"}", "{\"level\":\"info\",\"msg\":\"info\"}",
+		"{\"level\":\"warn\",\"msg\":\"warn\"}", "{\"level\":\"errr\",\"msg\":\"error\"}" };
+
+	if (console.size() != 2 || console[0] != "warn" || console[1] != "error")
+		throw std::runtime_error(strobj() << "per_device_priority_and_layout :: console got " << console.size() << " lines");
+
+	if (file.size() != 4 || std::equal(expectedfile, expectedfile + 4, file.begin()) == false)
+		throw std::runtime_error(strobj() << "per_device_priority_and_layout :: file got " << file.size() << " lines");
+
+	// when no device takes a priority the line is not even built
+	filedevice.setminpriority(slog::logtype_info::Priority);
+
+	uint32_t evaluated = 0;
+	SLOG(slog::debug) << "debug " << ++evaluated;
+
+	if (evaluated != 0 || file.size() != 4 || slog::debug::isenabled() || slog::info::isenabled() == false)
+		throw std::runtime_error(strobj() << "per_device_priority_and_layout :: a line nobody takes was built");
+
+	slog::debug::type.enabled = false;
+}
+
+static uint64_t lines_of(const slog::logstats& stats, const std::string& type)
+{
+	for (auto& each : stats.types)
+	{
+		if (each.name == type)
+			return each.lines;
+	}
+	return 0;
+}
+
+static const slog::logstats::devicestats* device_of(const slog::logstats& stats, const std::string& name)
+{
+	for (auto& each : stats.devices)
+	{
+		if (each.name == name)
+			return &each;
+	}
+	return nullptr;
+}
+
+void stats_count_lines_and_time_devices(int argc, char* argv[])
+{
+	for (uint64_t ns : { 0ull, 3ull, 4ull, 7ull, 8ull, 1000ull, 123456789ull, ~0ull })
+	{
+		const uint32_t bucket = slog::latencyhistogram::bucket(ns);
+		if (bucket >= slog::latencyhistogram::buckets || slog::latencyhistogram::lowerbound(bucket) > ns ||
+			(bucket + 1 < slog::latencyhistogram::buckets && slog::latencyhistogram::lowerbound(bucket + 1) <= ns))
+			throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: " << ns << " ns went to bucket " << bucket);
+	}
+
+	// the largest sample is the 100th percentile
+	slog::latencyhistogram histogram;
+	for (uint64_t ns : { 10ull, 20ull, 5000ull })
+	{
+		histogram.counts[slog::latencyhistogram::bucket(ns)]++;
+		histogram.count++;
+	}
+
+	if (histogram.percentile(1.0) < 5000 || histogram.percentile(0.0) >= 20 || slog::latencyhistogram().percentile(1.0) != 0)
+		throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: p100 is " << histogram.percentile(1.0));
+
+	slog::logconfig curconfig;
+	slog::logdevice_custom_function console("console", [](const slog::logtype& type, const std::string& line) { });
+
+	const slog::logstats before = slog::logstats::snapshot();
+
+	// a thread with more types than it has slots for counts the rest apart instead of under one of them.
+	// the types outlive the thread, its counters are added up when it exits
+	std::vector<slog::logtype> types(40);
+	std::thread([&types]()
+	{
+		for (size_t i = 0; i < types.size(); i++)
+		{
+			types[i].name = strobj() << "stats.type" << i;
+			slog::logstats::countline(types[i], 10);
+		}
+	}).join();
+	const uint32_t every = slog::logstats::timing();
+	slog::logstats::settiming(1);
+
+	{
+		// every line takes at least 100us on this device, one of them throws
+		slog::logdevice_custom_function slow("stats.slow", [](const slog::logtype& type, const std::string& line)
+		{
+			const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+			while (std::chrono::steady_clock::now() < until)
+				;
+
+			if (line.find("throw") != std::string::npos)
+				throw std::runtime_error("device failed");
+		});
+
+		// lines of a thread that already exited still count
+		std::thread([]() { for (int i = 0; i < 10; i++) slog::info() << "line " << i; }).join();
+
+		for (int i = 0; i < 3; i++)
+		{
+			slog::debug() << "off";
+			SLOG_FIRST(slog::warn, 1) << "first";
+		}
+
+		slog::error() << "throw";
+	}
+
+	slog::logstats::settiming(every);
+
+	const slog::logstats after = slog::logstats::snapshot();
+	const slog::logstats::devicestats* slow = device_of(after, "stats.slow");
+
+	if (lines_of(after, "info") - lines_of(before, "info") != 10 || lines_of(after, "warn") - lines_of(before, "warn") != 1)
+		throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: expected 10 info and 1 warn line");
+
+	if (lines_of(after, "stats.type31") != 1 || lines_of(after, "stats.type32") != 0 || lines_of(after, slog::logstats::othertypes()) - lines_of(before, slog::logstats::othertypes()) != 8)
+		throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: types past the last slot were counted as " << lines_of(after, "stats.type31"));
+
+	if (after.filtered - before.filtered != 3 || after.dropped - before.dropped != 2 || after.exceptions - before.exceptions != 1)
+		throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: filtered " << after.filtered - before.filtered <<
+			" dropped " << after.dropped - before.dropped << " exceptions " << after.exceptions - before.exceptions);
+
+	// the device is gone but what it wrote is kept under its name, the write that threw is counted but not timed
+	if (slow == nullptr || slow->lines != 12 || slow->latency.count != 11 || slow->latency.percentile(0.5) < 100000 || slow->bytes == 0)
+		throw std::runtime_error(strobj() << "stats_count_lines_and_time_devices :: the slow device was not timed");
+
+	std::atomic<uint32_t> reports(0);
+	{
+		slog::statsreporter reporter(std::chrono::milliseconds(5), [&reports](const slog::logstats& stats) { reports++; });
+		while (reports.load() < 2)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void flight_recorder_dumps_recent_lines_on_error(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	std::vector<std::string> console, dumped;
+	slog::logdevice_custom_function consoledevice("console", [&console](const slog::logtype& type, const std::string& line) { console.push_back(line); });
+
+	{
+		slog::logdevice_flightrecorder recorder([&dumped](const slog::logtype& type, const std::string& line) { dumped.push_back(line); }, 8);
+
+		// debug is off, its lines are only recorded
+		slog::debug() << "debug 1";
+		slog::info() << "info";
+		SLOG(slog::debug) << "debug 2";
+
+		if (console.size() != 1 || dumped.empty() == false)
+			throw std::runtime_error(strobj() << "flight_recorder_dumps_recent_lines_on_error :: a disabled line reached a device or a dump came early");
+
+		slog::error() << "failed";
+
+		const char* expected[] = { "debug 1", "info", "debug 2", "failed" };
+		if (dumped.size() != 4 || std::equal(expected, expected + 4, dumped.begin()) == false || console.size() != 2)
+			throw std::runtime_error(strobj() << "flight_recorder_dumps_recent_lines_on_error :: the error dumped " << dumped.size() << " lines");
+
+		// only the most recent lines are kept, and a dump only writes what came after the previous one
+		for (int i = 0; i < 20; i++)
+			slog::verbose().kv("i", i) << "verbose";
+
+		dumped.clear();
+		recorder.dump();
+		recorder.dump();
+
+		if (dumped.size() != 8 || dumped[0] != "verbose i=12" || dumped[7] != "verbose i=19")
+			throw std::runtime_error(strobj() << "flight_recorder_dumps_recent_lines_on_error :: the ring kept " << dumped.size() << " lines");
+
+		// a second recorder is refused, the first one keeps recording
+		bool refused = false;
+		try
+		{
+			slog::logdevice_flightrecorder second([](const slog::logtype& type, const std::string& line) { });
+		}
+		catch (const std::runtime_error&)
+		{
+			refused = true;
+		}
+
+		dumped.clear();
+		slog::error() << "still recording";
+
+		if (refused == false || dumped.size() != 1 || dumped[0] != "still recording")
+			throw std::runtime_error(strobj() << "flight_recorder_dumps_recent_lines_on_error :: a second recorder was not refused");
+	}
+
+	if (slog::debug::isenabled())
+		throw std::runtime_error(strobj() << "flight_recorder_dumps_recent_lines_on_error :: disabled lines are still built without a recorder");
+}
+
+// tests/min_priority_probe.cpp, built with SLOG_MIN_PRIORITY=150
+void min_priority_probe(uint32_t& evaluated);
+
+void min_priority_strips_lower_levels(int argc, char* argv[])
+{
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::verbose::type.enabled = true;
+	slog::debug::type.enabled = true;
+
+	std::vector<std::string> captured;
+	slog::logdevice_custom_function capture("console",
+		[&captured](const slog::logtype& type, const std::string& line)
+		{
+			captured.push_back(line);
+		});
+
+	uint32_t evaluated = 0;
+	min_priority_probe(evaluated);
+
+	slog::verbose::type.enabled = false;
+	slog::debug::type.enabled = false;
+
+	if (evaluated != 3 || captured.size() != 3 || captured[0] != "warn 1" || captured[1] != "error 2" || captured[2] != "audit 3")
+		throw std::runtime_error(strobj() << "min_priority_strips_lower_levels :: levels below SLOG_MIN_PRIORITY were logged or evaluated (" << evaluated << " arguments)");
+}
+
+void file_flush_policy(int argc, char* argv[])
+{
+	const char logfilename[] = "flushpolicy.test.log";
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+	{
+		slog::logdevice_file logfile(logfilename);
+
+		slog::info() << "buffered";
+		if (read_file(logfilename) != "")
+			throw std::runtime_error(strobj() << "file_flush_policy :: info line was written before any flush condition");
+
+		slog::error() << "error";
+		if (read_file(logfilename) != "buffered\nerror\n")
+			throw std::runtime_error(strobj() << "file_flush_policy :: error line did not flush the buffer");
+
+		slog::info() << "explicit";
+		logfile.flush();
+		if (read_file(logfilename) != "buffered\nerror\nexplicit\n")
+			throw std::runtime_error(strobj() << "file_flush_policy :: flush() did not write the buffer");
+
+		slog::info() << "on exit";
+	}
+
+	if (read_file(logfilename) != "buffered\nerror\nexplicit\non exit\n")
+		throw std::runtime_error(strobj() << "file_flush_policy :: buffered lines were lost when the device was destroyed");
+
+	{
+		slog::fileflushpolicy policy;
+		policy.maxbuffered = 16;
+		slog::logdevice_file logfile(logfilename, false, policy);
+
+		slog::info() << "0123456789";
+		if (read_file(logfilename) != "")
+			throw std::runtime_error(strobj() << "file_flush_policy :: flushed before reaching maxbuffered");
+
+		slog::info() << "0123456789";
+		if (read_file(logfilename) != "0123456789\n0123456789\n")
+			throw std::runtime_error(strobj() << "file_flush_policy :: did not flush after reaching maxbuffered");
+	}
+
+	{
+		slog::fileflushpolicy policy;
+		policy.interval = std::chrono::milliseconds(10);
+		slog::logdevice_file logfile(logfilename, false, policy);
+
+		slog::info() << "timer";
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (read_file(logfilename).empty() && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+		if (read_file(logfilename) != "timer\n")
+			throw std::runtime_error(strobj() << "file_flush_policy :: the timer did not flush the buffer");
+	}
+}
+
+#ifndef _WIN32
+void mmap_device_grows_across_chunks(int argc, char* argv[])
+{
+	const char logfilename[] = "mmap.test.log";
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+	std::string expected;
+
+	{
+		// a single page per chunk so a few hundred lines remap several times
+		slog::logdevice_mmap logfile(logfilename, false, 1);
+
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			slog::info() << "mmap line " << i;
+			expected += strobj() << "mmap line " << i << "\n";
+		}
+	}
+
+	if (read_file(logfilename) != expected)
+		throw std::runtime_error(strobj() << "mmap_device_grows_across_chunks :: file contents do not match what was logged");
+
+	// append continues where the file ends
+	{
+		slog::logdevice_mmap logfile(logfilename, true, 1);
+		slog::info() << "appended";
+		expected += "appended\n";
+	}
+
+	if (read_file(logfilename) != expected)
+		throw std::runtime_error(strobj() << "mmap_device_grows_across_chunks :: appending did not continue at the end of the file");
+}
+
+void mmap_device_survives_abrupt_exit(int argc, char* argv[])
+{
+	const char logfilename[] = "mmap_abrupt.test.log";
+
+	pid_t child = fork();
+	if (child < 0)
+		throw std::runtime_error(strobj() << "mmap_device_survives_abrupt_exit :: fork failed");
+
+	if (child == 0)
+	{
+		slog::logconfig curconfig;
+		curconfig.timestamps = false;
+		curconfig.print_logtype = false;
+
+		slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+		// leaked on purpose, the process ends without the destructor running
+		new slog::logdevice_mmap(logfilename);
+
+		slog::info() << "written before";
+		slog::info() << "the crash";
+
+		// no destructors, no flush, no truncate
+		_exit(0);
+	}
+
+	int status = 0;
+	waitpid(child, &status, 0);
+
+	const std::string contents = read_file(logfilename);
+	const std::string expected = "written before\nthe crash\n";
+
+	if (contents.compare(0, expected.size(), expected) != 0)
+		throw std::runtime_error(strobj() << "mmap_device_survives_abrupt_exit :: lines are missing after an abrupt exit");
+
+	if (contents.find_first_not_of('\0', expected.size()) != std::string::npos)
+		throw std::runtime_error(strobj() << "mmap_device_survives_abrupt_exit :: the preallocated tail is not zero filled");
+}
+
+// a pipe is not a terminal so no escape codes, and lines from several threads come out whole
+void console_writes_whole_lines_to_a_pipe(int argc, char* argv[])
+{
+	const uint32_t threads = 4;
+	const uint32_t lines = 2000;
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+	curconfig.usecolor = true;
+
+	int fds[2];
+	if (pipe(fds) != 0)
+		throw std::runtime_error(strobj() << "console_writes_whole_lines_to_a_pipe :: pipe failed");
+
+	std::string output;
+	std::thread drain([&output, &fds]()
+	{
+		char buffer[4096];
+		ssize_t length;
+		while ((length = read(fds[0], buffer, sizeof(buffer))) > 0)
+			output.append(buffer, (size_t)length);
+	});
+
+	fflush(stdout);
+	const int savedstdout = dup(1);
+	dup2(fds[1], 1);
+
+	{
+		slog::logdevice_console device;
+
+		std::vector<std::thread> writers;
+		for (uint32_t t = 0; t < threads; t++)
+		{
+			writers.push_back(std::thread([t, lines]()
+			{
+				for (uint32_t i = 0; i < lines; i++)
+					slog::info() << "thread " << t << " line " << i << " with some padding to make it longer";
+			}));
+		}
+
+		for (auto& writer : writers)
+			writer.join();
+
+		// still sitting in the stdio buffer of a pipe, it has to come out ahead of the line logged after it
+		printf("from printf\n");
+		std::cout << "from cout\n";
+		slog::info() << "after stdio";
+	}
+
+	dup2(savedstdout, 1);
+	close(savedstdout);
+	close(fds[1]);
+	drain.join();
+	close(fds[0]);
+
+	if (output.find('\x1B') != std::string::npos)
+		throw std::runtime_error(strobj() << "console_writes_whole_lines_to_a_pipe :: color codes written to a pipe");
+
+	const std::string tail = "from printf\nfrom cout\nafter stdio\n";
+	if (output.size() < tail.size() || output.compare(output.size() - tail.size(), tail.size(), tail) != 0)
+		throw std::runtime_error("console_writes_whole_lines_to_a_pipe :: a line overtook output still buffered by stdio");
+	output.resize(output.size() - tail.size());
+
+	std::vector<uint32_t> next(threads, 0);
+	std::istringstream in(output);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		uint32_t t = 0;
+		uint32_t i = 0;
+		if (sscanf(line.c_str(), "thread %u line %u", &t, &i) != 2 || t >= threads || i != next[t]++ ||
+			line != (std::string)(strobj() << "thread " << t << " line " << i << " with some padding to make it longer"))
+			throw std::runtime_error(strobj() << "console_writes_whole_lines_to_a_pipe :: torn or out of order line '" << line << "'");
+	}
+
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		if (next[t] != lines)
+			throw std::runtime_error(strobj() << "console_writes_whole_lines_to_a_pipe :: thread " << t << " wrote " << next[t] << " lines");
+	}
+}
+
+static int listen_unix(const char* path, int type)
+{
+	unlink(path);
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	const int fd = socket(AF_UNIX, type, 0);
+	if (fd < 0 || bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || (type == SOCK_STREAM && listen(fd, 4) != 0))
+		throw std::runtime_error(strobj() << "listen_unix :: can not listen on '" << path << "'");
+
+	return fd;
+}
+
+// reads until length bytes came in or nothing came for a second
+static std::string read_stream(int fd, size_t length)
+{
+	std::string received;
+	while (received.size() < length)
+	{
+		pollfd readable = { fd, POLLIN, 0 };
+		char buffer[4096];
+		const ssize_t got = (poll(&readable, 1, 1000) == 1) ? read(fd, buffer, sizeof(buffer)) : 0;
+		if (got <= 0)
+			break;
+		received.append(buffer, (size_t)got);
+	}
+	return received;
+}
+
+// waits up to timeout milliseconds for a datagram
+static std::string read_datagram(int fd, int timeout = 1000)
+{
+	pollfd readable = { fd, POLLIN, 0 };
+	char buffer[4096];
+	const ssize_t got = (poll(&readable, 1, timeout) == 1) ? recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) : 0;
+	return std::string(buffer, got > 0 ? (size_t)got : 0);
+}
+
+void socket_device_outlives_the_collector(int argc, char* argv[])
+{
+	const char path[] = "slog.test.sock";
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	// rfc5424 datagrams, dropped while the collector is away
+	{
+		int collector = listen_unix(path, SOCK_DGRAM);
+
+		slog::socketpolicy policy;
+		policy.appname = "tests";
+		policy.reconnect = std::chrono::milliseconds(0);
+		slog::logdevice_socket device(path, policy);
+
+		slog::info() << "first";
+		slog::error() << "second";
+
+		const std::string header = strobj() << " tests " << getpid() << " - - ";
+		const std::string first = read_datagram(collector);
+		const std::string second = read_datagram(collector);
+
+		// <PRI>1 2014-06-01T13:45:10.250000Z HOSTNAME tests PID - - message
+		if (first.compare(0, 6, "<14>1 ") != 0 || first.find('Z') != 32 || first.size() < header.size() + 5 || first.compare(first.size() - header.size() - 5, std::string::npos, header + "first") != 0 ||
+			second.compare(0, 6, "<11>1 ") != 0 || second.find(header + "second") == std::string::npos)
+			throw std::runtime_error(strobj() << "socket_device_outlives_the_collector :: unexpected records '" << first << "' '" << second << "'");
+
+		close(collector);
+		unlink(path);
+
+		const uint64_t dropped = slog::logstats::snapshot().dropped;
+		slog::info() << "lost";
+		if (device.connected() || slog::logstats::snapshot().dropped != dropped + 1)
+			throw std::runtime_error("socket_device_outlives_the_collector :: a record sent while the collector was away was not dropped");
+
+		collector = listen_unix(path, SOCK_DGRAM);
+		slog::info() << "back";
+
+		const std::string back = read_datagram(collector);
+		if (back.find(header + "back") == std::string::npos || read_datagram(collector, 0).empty() == false)
+			throw std::runtime_error(strobj() << "socket_device_outlives_the_collector :: did not reconnect, got '" << back << "'");
+
+		close(collector);
+	}
+
+	// plain lines on a stream, batches from the async writer, buffered while the collector is away
+	{
+		int collector = listen_unix(path, SOCK_STREAM);
+
+		slog::socketpolicy policy;
+		policy.stream = true;
+		policy.framing = slog::socketframing::plain;
+		policy.buffer = true;
+		policy.reconnect = std::chrono::milliseconds(0);
+		slog::logdevice_socket device(path, policy);
+
+		int peer = accept(collector, nullptr, nullptr);
+
+		std::string expected;
+		curconfig.startasync();
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			slog::info() << "line " << i;
+			expected += strobj() << "line " << i << "\n";
+		}
+		curconfig.stopasync();
+
+		// the collector is not reading yet, what it could not take is sent by the retry thread while it reads
+		const std::string batched = read_stream(peer, expected.size());
+		if (device.flush() == false)
+			throw std::runtime_error("socket_device_outlives_the_collector :: the buffer did not drain");
+		if (batched != expected)
+			throw std::runtime_error(strobj() << "socket_device_outlives_the_collector :: the stream got " << batched.size() << " of " << expected.size() << " bytes");
+
+		close(peer);
+		close(collector);
+		unlink(path);
+
+		expected.clear();
+		for (uint32_t i = 0; i < 10; i++)
+		{
+			slog::info() << "buffered " << i;
+			expected += strobj() << "buffered " << i << "\n";
+		}
+
+		if (device.connected())
+			throw std::runtime_error("socket_device_outlives_the_collector :: still connected to a collector that went away");
+
+		// nothing else is written, the retry thread reconnects on its own
+		collector = listen_unix(path, SOCK_STREAM);
+		if (device.flush() == false)
+			throw std::runtime_error("socket_device_outlives_the_collector :: did not send what was buffered once the collector was back");
+
+		peer = accept(collector, nullptr, nullptr);
+		const std::string buffered = read_stream(peer, expected.size());
+		if (buffered != expected)
+			throw std::runtime_error(strobj() << "socket_device_outlives_the_collector :: lost what was buffered, got '" << buffered << "'");
+
+		close(peer);
+		close(collector);
+	}
+
+	unlink(path);
+}
+
+void flight_recorder_dumps_on_fatal_signal(int argc, char* argv[])
+{
+	const char dumpfilename[] = "flightrecorder.test.log";
+	unlink(dumpfilename);
+
+	pid_t child = fork();
+	if (child < 0)
+		throw std::runtime_error(strobj() << "flight_recorder_dumps_on_fatal_signal :: fork failed");
+
+	if (child == 0)
+	{
+		slog::logconfig curconfig;
+		slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+		slog::logdevice_flightrecorder recorder(dumpfilename);
+		recorder.dumponfatalsignal();
+
+		slog::debug() << "state before the crash";
+		abort();
+	}
+
+	int status = 0;
+	waitpid(child, &status, 0);
+
+	const std::string contents = read_file(dumpfilename);
+
+	if (WIFSIGNALED(status) == false || WTERMSIG(status) != SIGABRT)
+		throw std::runtime_error(strobj() << "flight_recorder_dumps_on_fatal_signal :: the previous handler did not get the signal");
+
+	if (contents.find("] - [debg] - state before the crash\n") == std::string::npos)
+		throw std::runtime_error(strobj() << "flight_recorder_dumps_on_fatal_signal :: the dump is missing the recorded line: " << contents);
+}
+#endif
+
+void file_rotation_keeps_every_line(int argc, char* argv[])
+{
+	const std::string logfilename = "rotation.test.log";
+	const uint32_t threads = 4;
+	const uint32_t lines = 5000;
+
+	remove_segments(logfilename, 1000);
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+	{
+		slog::filerotationpolicy rotation;
+		rotation.maxsize = 16 * 1024;
+		rotation.keep = 0;
+
+		slog::fileflushpolicy flush;
+		flush.maxbuffered = 4096;
+
+		slog::logdevice_file logfile(logfilename, false, flush, rotation);
+
+		std::vector<std::thread> writers;
+		for (uint32_t t = 0; t < threads; t++)
+		{
+			writers.emplace_back([t, lines]()
+			{
+				for (uint32_t i = 0; i < lines; i++)
+					slog::info() << t << " " << i;
+			});
+		}
+
+		for (auto& each : writers)
+			each.join();
+	}
+
+	// every line must show up exactly once, and in order for each thread
+	std::vector<uint32_t> next(threads, 0);
+	uint32_t segments = 0;
+
+	auto check = [&next](const std::string& contents)
+	{
+		std::istringstream ss(contents);
+		uint32_t t, i;
+		while (ss >> t >> i)
+		{
+			if (t >= next.size() || next[t] != i)
+				throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: line '" << t << " " << i << "' lost, duplicated or out of order");
+			next[t]++;
+		}
+	};
+
+	std::string contents;
+	for (uint32_t n = 1; read_segment(strobj() << logfilename << "." << n, contents); n++)
+	{
+		if (contents.size() > 16 * 1024)
+			throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: segment " << n << " is larger than maxsize");
+		check(contents);
+		segments++;
+	}
+
+	check(read_file(logfilename.c_str()));
+
+	if (segments < 2)
+		throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: expected the file to rotate, got " << segments << " segments");
+
+	for (uint32_t t = 0; t < threads; t++)
+	{
+		if (next[t] != lines)
+			throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: thread " << t << " lost lines, got " << next[t]);
+	}
+
+	// with a retention count only the newest segments survive
+	{
+		slog::filerotationpolicy rotation;
+		rotation.maxsize = 1024;
+		rotation.keep = 2;
+
+		slog::logdevice_file logfile(logfilename, false, slog::fileflushpolicy(), rotation);
+
+		for (uint32_t i = 0; i < 1000; i++)
+			slog::info() << "retention " << i;
+	}
+
+	uint32_t kept = 0;
+	for (uint32_t n = 1; n < 1000; n++)
+	{
+		if (read_segment(strobj() << logfilename << "." << n, contents))
+			kept++;
+	}
+
+	if (kept != 2)
+		throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: expected 2 segments to be kept, found " << kept);
+
+	// a restart after retention ran continues after the highest segment instead of reusing the deleted low ones
+	uint32_t highest = 0;
+	for (uint32_t n = 1; n < 1000; n++)
+	{
+		if (read_segment(strobj() << logfilename << "." << n, contents))
+			highest = n;
+	}
+
+	{
+		slog::filerotationpolicy rotation;
+		rotation.maxsize = 1024;
+		rotation.keep = 2;
+
+		slog::logdevice_file logfile(logfilename, true, slog::fileflushpolicy(), rotation);
+
+		for (uint32_t i = 0; i < 100; i++)
+			slog::info() << "restarted " << i;
+	}
+
+	kept = 0;
+	uint32_t newest = 0;
+	for (uint32_t n = 1; n < 1000; n++)
+	{
+		if (read_segment(strobj() << logfilename << "." << n, contents))
+		{
+			newest = n;
+			kept++;
+		}
+	}
+
+	if (kept != 2 || newest <= highest)
+		throw std::runtime_error(strobj() << "file_rotation_keeps_every_line :: after a restart expected 2 segments ending past " << highest << ", found " << kept << " up to " << newest);
+}
+
+void file_rotation_by_interval(int argc, char* argv[])
+{
+	const std::string logfilename = "rotation_interval.test.log";
+
+	remove_segments(logfilename, 10);
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+	{
+		slog::filerotationpolicy rotation;
+		rotation.interval = std::chrono::seconds(1);
+
+		slog::logdevice_file logfile(logfilename, false, slog::fileflushpolicy(), rotation);
+
+		slog::info() << "before";
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+		slog::info() << "after";
+	}
+
+	std::string contents;
+	if (read_segment(logfilename + ".1", contents) == false || contents != "before\n" || read_file(logfilename.c_str()) != "after\n")
+		throw std::runtime_error(strobj() << "file_rotation_by_interval :: the file was not rotated on the interval");
+}
+
+void lz_round_trips(int argc, char* argv[])
+{
+	std::vector<std::string> inputs;
+	inputs.push_back("");
+	inputs.push_back("a");
+	inputs.push_back("abcd");
+	inputs.push_back(std::string(100000, 'x'));
+
+	std::string text;
+	for (uint32_t i = 0; i < 2000; i++)
+		text += strobj() << "[2014-06-01 13:45:10] - [info] - request " << i << " served in " << (i * 7) % 100 << "ms\n";
+	inputs.push_back(text.substr(0, 65536));
+
+	std::string noise;
+	uint32_t seed = 12345;
+	for (uint32_t i = 0; i < 5000; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		noise.push_back((char)(seed >> 16));
+	}
+	inputs.push_back(noise);
+
+	for (auto& input : inputs)
+	{
+		std::string compressed;
+		std::string decompressed;
+		slog::lz::compress(input.data(), input.size(), compressed);
+
+		if (slog::lz::decompress(compressed.data(), compressed.size(), input.size(), decompressed) == false || decompressed != input)
+			throw std::runtime_error(strobj() << "lz_round_trips :: round trip failed for an input of " << input.size() << " bytes");
+	}
+
+	std::string compressed;
+	slog::lz::compress(inputs[4].data(), inputs[4].size(), compressed);
+	if (compressed.size() * 3 > inputs[4].size())
+		throw std::runtime_error(strobj() << "lz_round_trips :: log text only compressed to " << compressed.size() << " of " << inputs[4].size() << " bytes");
+}
+
+void blockfile_reads_time_ranges(int argc, char* argv[])
+{
+	const char logfilename[] = "blockfile.test.slogblk";
+
+	slog::logconfig curconfig;
+	curconfig.timestamps = false;
+	curconfig.print_logtype = false;
+
+	slog::logdevice_custom_function quiet("console", [](const slog::logtype& type, const std::string& line) { });
+
+	std::chrono::system_clock::time_point middlefrom;
+	std::chrono::system_clock::time_point middleto;
+
+	{
+		slog::logdevice_blockfile logfile(logfilename, false, 1024);
+
+		for (uint32_t i = 0; i < 500; i++)
+			slog::info() << "early line " << i;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		middlefrom = std::chrono::system_clock::now();
+
+		for (uint32_t i = 0; i < 500; i++)
+			slog::info() << "middle line " << i;
+
+		middleto = std::chrono::system_clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		for (uint32_t i = 0; i < 500; i++)
+			slog::info() << "late line " << i;
+	}
+
+	slog::blocklogreader reader(logfilename);
+
+	std::vector<std::string> lines;
+	auto collect = [&lines](std::chrono::system_clock::time_point when, const std::string& line) { lines.push_back(line); };
+
+	reader.read(std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(), collect);
+	if (lines.size() != 1500 || lines[0] != "early line 0" || lines[1499] != "late line 499")
+		throw std::runtime_error(strobj() << "blockfile_reads_time_ranges :: expected 1500 lines back, got " << lines.size());
+
+	lines.clear();
+	const size_t decompressed = reader.read(middlefrom, middleto, collect);
+
+	if (lines.size() != 500 || lines[0] != "middle line 0" || lines[499] != "middle line 499")
+		throw std::runtime_error(strobj() << "blockfile_reads_time_ranges :: expected the 500 middle lines, got " << lines.size());
+
+	if (decompressed * 2 > reader.blocks().size())
+		throw std::runtime_error(strobj() << "blockfile_reads_time_ranges :: decompressed " << decompressed << " of " << reader.blocks().size() << " blocks for a third of the lines");
+
+	// a block header torn by an unclean exit is cut off when the file is appended to
+	{
+		std::ofstream torn(logfilename, std::ios::out | std::ios::binary | std::ios::app);
+		torn.write("\x10\x00\x00\x00\x20", 5);
+	}
+
+	{
+		slog::logdevice_blockfile logfile(logfilename, true, 1024);
+		slog::info() << "appended";
+	}
+
+	lines.clear();
+	slog::blocklogreader appended(logfilename);
+	appended.read(std::chrono::system_clock::time_point::min(), std::chrono::system_clock::time_point::max(), collect);
+	if (lines.size() != 1501 || lines.back() != "appended")
+		throw std::runtime_error(strobj() << "blockfile_reads_time_ranges :: expected 1501 lines after appending to a torn file, got " << lines.size());
+}
+
+// -------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		emptylog(argc, argv);
+		simple_log_line(argc, argv);
+		default_verbose_debug_off(argc, argv);
+		empty_lines_should_print(argc, argv);
+		async_logging_keeps_caller_latency_flat(argc, argv);
+		async_writer_hands_devices_batches(argc, argv);
+		async_can_stop_while_logging(argc, argv);
+		async_batch_survives_a_throwing_device(argc, argv);
+		devices_can_come_and_go_while_logging(argc, argv);
+		devices_cannot_be_added_from_a_device(argc, argv);
+		logging_does_not_allocate_in_steady_state(argc, argv);
+		utc_timestamps_with_subsecond_precision(argc, argv);
+		binary_log_round_trips_to_text(argc, argv);
+		fmt_matches_stream_output(argc, argv);
+		formatting_matches_ostream(argc, argv);
+		cycle_counter_timestamps_track_the_system_clock(argc, argv);
+		lazy_arguments_are_not_evaluated(argc, argv);
+		min_priority_strips_lower_levels(argc, argv);
+		categories_inherit_levels(argc, argv);
+		call_site_limits(argc, argv);
+		repeated_lines_are_collapsed(argc, argv);
+		structured_fields_per_layout(argc, argv);
+		per_device_priority_and_layout(argc, argv);
+		stats_count_lines_and_time_devices(argc, argv);
+		flight_recorder_dumps_recent_lines_on_error(argc, argv);
+		file_flush_policy(argc, argv);
+		file_rotation_keeps_every_line(argc, argv);
+		file_rotation_by_interval(argc, argv);
+		lz_round_trips(argc, argv);
+		blockfile_reads_time_ranges(argc, argv);
+#ifndef _WIN32
+		mmap_device_grows_across_chunks(argc, argv);
+		mmap_device_survives_abrupt_exit(argc, argv);
+		console_writes_whole_lines_to_a_pipe(argc, argv);
+		flight_recorder_dumps_on_fatal_signal(argc, argv);
+		socket_device_outlives_the_collector(argc, argv);
+#endif
 
 		slog::logconfig benchconfig(argc, argv);
 		slog::verbose::type.enabled = true;
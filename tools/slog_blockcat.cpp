@@ -0,0 +1,103 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+// prints the lines of a log written by logdevice_blockfile, optionally only those of a time range.
+// blocks outside the range are skipped without being decompressed
+//
+//	slog_blockcat [--from=SECONDS] [--to=SECONDS] [--blocks] file
+//
+// times are seconds since the epoch, --blocks lists the block headers instead of the lines
+
+#include <slog/slog.h>
+#include <slog/slog_logdevice_blockfile.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static std::chrono::system_clock::time_point parse_seconds(const char* value)
+{
+	return std::chrono::system_clock::time_point(std::chrono::microseconds((int64_t)(std::atof(value) * 1000000.0)));
+}
+
+static double to_seconds(std::chrono::system_clock::time_point when)
+{
+	return std::chrono::duration<double>(when.time_since_epoch()).count();
+}
+
+int main(int argc, char* argv[])
+{
+	auto from = std::chrono::system_clock::time_point::min();
+	auto to = std::chrono::system_clock::time_point::max();
+	bool listblocks = false;
+	const char* filename = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strncmp(argv[i], "--from=", 7) == 0)
+			from = parse_seconds(argv[i] + 7);
+		else if (std::strncmp(argv[i], "--to=", 5) == 0)
+			to = parse_seconds(argv[i] + 5);
+		else if (std::strcmp(argv[i], "--blocks") == 0)
+			listblocks = true;
+		else
+			filename = argv[i];
+	}
+
+	if (filename == nullptr)
+	{
+		fprintf(stderr, "usage: %s [--from=SECONDS] [--to=SECONDS] [--blocks] file\n", argv[0]);
+		return 1;
+	}
+
+	try
+	{
+		slog::blocklogreader reader(filename);
+
+		if (listblocks)
+		{
+			for (auto& block : reader.blocks())
+			{
+				printf("offset %llu lines %u raw %u compressed %u first %.6f last %.6f\n", (unsigned long long)block.offset, block.lines,
+					block.rawsize, block.compressedsize, to_seconds(block.first), to_seconds(block.last));
+			}
+			return 0;
+		}
+
+		reader.read(from, to, [](std::chrono::system_clock::time_point, const std::string& line)
+		{
+			fwrite(line.data(), 1, line.size(), stdout);
+			fputc('\n', stdout);
+		});
+	}
+	catch (std::exception& e)
+	{
+		fprintf(stderr, "%s: %s\n", filename, e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+//================================================================================
+//
+//	The MIT License (MIT)
+//
+//	Copyright (c) 2014 Konstantinos Sofokleous
+//
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+//
+//	The above copyright notice and this permission notice shall be included in
+//	all copies or substantial portions of the Software.
+//
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//	THE SOFTWARE.
+//
+//================================================================================
+
+// turns a log written by logdevice_binary_file back into the text the text front ends would have printed
+//
+//	slog_decode [--log=...] file
+//
+// the --log= options are the same as for any slog program, e.g. --log=-timestamps or --log=+utc
+
+#include <slog/slog.h>
+#include <slog/slog_binary.h>
+
+#include <cstdio>
+
+int main(int argc, char* argv[])
+{
+	slog::logconfig config(argc, argv);
+	config.usecolor = false;
+
+	const char* filename = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]).compare(0, 6, "--log=") != 0)
+			filename = argv[i];
+	}
+
+	if (filename == nullptr)
+	{
+		fprintf(stderr, "usage: %s [--log=...] file\n", argv[0]);
+		return 1;
+	}
+
+	try
+	{
+		slog::binarylogreader reader(filename);
+		slog::binarylogreader::entry e;
+		slog::linebuffer line;
+
+		while (reader.next(e))
+		{
+			if (e.preformatted)
+			{
+				fwrite(e.text.data(), 1, e.text.size(), stdout);
+			}
+			else
+			{
+				slog::logconfig::formatmsg(*e.type, e.text.data(), e.text.size(), line, e.when);
+				fwrite(line.data(), 1, line.size(), stdout);
+			}
+			fputc('\n', stdout);
+		}
+	}
+	catch (std::exception& e)
+	{
+		fprintf(stderr, "%s: %s\n", filename, e.what());
+		return 1;
+	}
+
+	return 0;
+}